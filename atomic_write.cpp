@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "atomic_write.h"
+
+using namespace std;
+
+static bool sync_path(const string& path, int flags)
+{
+	int fd = open(path.c_str(), flags);
+	if (fd == -1)
+		return false;
+
+	bool ok = fsync(fd) == 0;
+	int err = errno;
+	close(fd);
+	errno = err;
+
+	return ok;
+}
+
+bool atomic_write(const string& filename, const function<void(ostream& out)>& write)
+{
+	string tmp = filename + ".tmp";
+
+	ofstream out(tmp, ofstream::binary | ofstream::trunc);
+	if (out.fail())
+		return false;
+
+	write(out);
+	out.close();
+
+	if (out.fail() || !sync_path(tmp, O_RDONLY))
+	{
+		int err = errno;
+		unlink(tmp.c_str());
+		errno = err;
+		return false;
+	}
+
+	if (rename(tmp.c_str(), filename.c_str()) != 0)
+		return false;
+
+	/* The rename itself only lasts once the directory is synced */
+	size_t slash = filename.rfind('/');
+	string dir = slash == string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+
+	return sync_path(dir, O_RDONLY | O_DIRECTORY);
+}
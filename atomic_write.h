@@ -0,0 +1,13 @@
+#ifndef ATOMIC_WRITE_H
+#define ATOMIC_WRITE_H
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+/* Replaces filename with whatever write() puts out. It's written to a
+ * temporary, synced and renamed over the original, so neither a crash nor a
+ * power cut leaves a truncated file behind: it's the old one or the new one. */
+bool atomic_write(const std::string& filename, const std::function<void(std::ostream& out)>& write);
+
+#endif /* ATOMIC_WRITE_H */
@@ -0,0 +1,148 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "classify.h"
+
+using namespace std;
+
+/* Times banner_classifier on one core. Without -f, it makes up its own
+ * signatures (a quarter of them case-insensitive) and banners of random
+ * printable text, with one in ten containing a signature. The seed is fixed,
+ * so two builds classify the same banners. */
+
+static string random_text(mt19937& rng, size_t n)
+{
+	string s(n, ' ');
+	for (auto& c: s)
+		c = ' ' + rng() % 95;
+
+	return s;
+}
+
+int main(int argc, char** argv)
+{
+	const char* signatures_filename = nullptr;
+	size_t n_signatures = 1000;
+	size_t n_banners = 200000;
+	size_t banner_size = 512;
+	int repeat = 2;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:s:b:z:r:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				signatures_filename = optarg;
+				break;
+			case 's':
+				n_signatures = strtoull(optarg, nullptr, 10);
+				break;
+			case 'b':
+				n_banners = strtoull(optarg, nullptr, 10);
+				break;
+			case 'z':
+				banner_size = strtoull(optarg, nullptr, 10);
+				break;
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				cerr << "Usage: " << argv[0] << " [options]\n";
+				cerr << "\t-f: Use this signatures file, instead of made up ones\n";
+				cerr << "\t-s: Number of made up signatures (default 1000)\n";
+				cerr << "\t-b: Number of banners (default 200000)\n";
+				cerr << "\t-z: Banner size in bytes (default 512)\n";
+				cerr << "\t-r: Classify every banner this many times (default 2)\n";
+				return 1;
+		}
+	}
+
+	mt19937 rng(1);
+	vector<string> patterns;
+
+	string filename;
+	if (signatures_filename)
+	{
+		filename = signatures_filename;
+	}
+	else
+	{
+		char tmp[] = "/tmp/connector-bench-XXXXXX";
+		int fd = mkstemp(tmp);
+		if (fd == -1)
+		{
+			cerr << "Could not create a signatures file: " << strerror(errno) << '\n';
+			return 1;
+		}
+		close(fd);
+		filename = tmp;
+
+		/* Letters and digits only, so nothing needs escaping */
+		static const char alnum[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+		ofstream out(filename);
+		for (size_t i = 0; i < n_signatures; i++)
+		{
+			string p(6 + rng() % 15, ' ');
+			for (auto& c: p)
+				c = alnum[rng() % (sizeof(alnum) - 1)];
+
+			out << "sig" << i << '\t' << p << (i % 4 ? "" : "\ti") << '\n';
+			patterns.push_back(p);
+		}
+	}
+
+	banner_classifier classifier;
+	auto start = chrono::steady_clock::now();
+	bool loaded = classifier.load(filename);
+	chrono::duration<double> load_time = chrono::steady_clock::now() - start;
+
+	if (!signatures_filename)
+		unlink(filename.c_str());
+
+	if (!loaded)
+	{
+		cerr << "Could not load " << filename << ": " << strerror(errno) << '\n';
+		return 1;
+	}
+
+	vector<string> banners(n_banners);
+	for (auto& b: banners)
+	{
+		b = random_text(rng, banner_size);
+		if (!patterns.empty() && rng() % 10 == 0)
+		{
+			const string& p = patterns[rng() % patterns.size()];
+			if (p.size() <= b.size())
+				b.replace(rng() % (b.size() - p.size() + 1), p.size(), p);
+		}
+	}
+
+	size_t labelled = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++)
+	{
+		for (auto& b: banners)
+			labelled += classifier.classify(b) != nullptr;
+	}
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	size_t total = n_banners * repeat;
+
+	cout << classifier.size() << " signatures, loaded in " << load_time.count() << " s\n";
+	cout << total << " banners of " << banner_size << " bytes, " << labelled << " labelled, in "
+	     << elapsed.count() << " s (" << (uint64_t) (total / elapsed.count()) << " banners/s, "
+	     << total * banner_size / elapsed.count() / 1e6 << " MB/s)\n";
+
+	return 0;
+}
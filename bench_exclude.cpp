@@ -0,0 +1,73 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "exclude.h"
+
+using namespace std;
+
+/* Times cidr_set lookups against a large, random exclusion list: ranges from
+ * /32 to /24, scattered over the whole address space, like a merged blocklist.
+ * The seed is fixed, so two builds run the same lookups. */
+
+int main(int argc, char** argv)
+{
+	size_t n_ranges = 1000000;
+	size_t n_lookups = 20000000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "e:l:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'e':
+				n_ranges = strtoull(optarg, nullptr, 10);
+				break;
+			case 'l':
+				n_lookups = strtoull(optarg, nullptr, 10);
+				break;
+			case 'h':
+			default:
+				cerr << "Usage: " << argv[0] << " [options]\n";
+				cerr << "\t-e: Number of excluded ranges (default 1000000)\n";
+				cerr << "\t-l: Number of lookups (default 20000000)\n";
+				return 1;
+		}
+	}
+
+	mt19937 rng(1);
+
+	cidr_set set;
+	for (size_t i = 0; i < n_ranges; i++)
+	{
+		int bits = 24 + rng() % 9;
+		uint32_t mask = ~0u << (32 - bits);
+		uint32_t first = rng() & mask;
+		set.add(first, first | ~mask);
+	}
+
+	auto start = chrono::steady_clock::now();
+	set.compile();
+	chrono::duration<double> compile_time = chrono::steady_clock::now() - start;
+
+	/* Generated up front, so only the lookups are timed */
+	vector<uint32_t> addrs(n_lookups);
+	for (auto& a: addrs)
+		a = rng();
+
+	size_t hits = 0;
+	start = chrono::steady_clock::now();
+	for (uint32_t a: addrs)
+		hits += set.contains(a);
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	cout << n_ranges << " ranges (" << set.size() << " after merging), compiled in "
+	     << compile_time.count() << " s\n";
+	cout << n_lookups << " lookups, " << hits << " excluded, in " << elapsed.count() << " s ("
+	     << elapsed.count() * 1e9 / n_lookups << " ns/lookup)\n";
+
+	return 0;
+}
@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <ctype.h>
+#include <fstream>
+#include <deque>
+#include <algorithm>
+
+#include "classify.h"
+
+using namespace std;
+
+/* Signature file: one "label<TAB>pattern" per line, optionally followed by
+ * "<TAB>i" for case-insensitive matching. Patterns are literal strings that
+ * may contain \r, \n, \t, \\ and \xNN escapes. Lines starting with # are
+ * comments. */
+bool banner_classifier::load(const string& filename)
+{
+	ifstream in(filename);
+	if (in.fail())
+		return false;
+
+	vector<pair<string, uint32_t>> exact_patterns;
+	vector<pair<string, uint32_t>> folded_patterns;
+	labels.clear();
+
+	string s;
+	while (getline(in, s))
+	{
+		if (!s.empty() && s.back() == '\r')
+			s.pop_back();
+
+		if (s.empty() || s[0] == '#')
+			continue;
+
+		size_t tab1 = s.find('\t');
+		if (tab1 == string::npos || tab1 == 0)
+		{
+			errno = EINVAL;
+			return false;
+		}
+
+		size_t tab2 = s.find('\t', tab1 + 1);
+		string flags = tab2 == string::npos ? string() : s.substr(tab2 + 1);
+
+		string pattern;
+		if (!unescape(s.substr(tab1 + 1, tab2 == string::npos ? string::npos : tab2 - tab1 - 1), pattern) ||
+				pattern.empty() || (flags != "" && flags != "i"))
+		{
+			errno = EINVAL;
+			return false;
+		}
+
+		uint32_t index = labels.size();
+		labels.push_back(s.substr(0, tab1));
+
+		if (flags == "i")
+			folded_patterns.emplace_back(pattern, index);
+		else
+			exact_patterns.emplace_back(pattern, index);
+	}
+
+	exact = automaton();
+	folded = automaton();
+
+	if (!exact_patterns.empty())
+		exact.build(exact_patterns, false);
+	if (!folded_patterns.empty())
+		folded.build(folded_patterns, true);
+
+	return true;
+}
+
+bool banner_classifier::unescape(const string& in, string& out)
+{
+	out.clear();
+
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		if (in[i] != '\\')
+		{
+			out += in[i];
+			continue;
+		}
+
+		if (++i == in.size())
+			return false;
+
+		switch (in[i])
+		{
+			case 'r': out += '\r'; break;
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case '\\': out += '\\'; break;
+			case 'x':
+				if (i + 2 >= in.size() || !isxdigit(in[i + 1]) || !isxdigit(in[i + 2]))
+					return false;
+				out += (char) stoi(in.substr(i + 1, 2), nullptr, 16);
+				i += 2;
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void banner_classifier::automaton::build(const vector<pair<string, uint32_t>>& patterns, bool fold)
+{
+	/* Number the bytes that are actually used */
+	fill(begin(classes), end(classes), 0);
+	n_classes = 1;
+	for (auto& p: patterns)
+	{
+		for (unsigned char ch: p.first)
+		{
+			if (fold)
+				ch = tolower(ch);
+			if (!classes[ch])
+				classes[ch] = n_classes++;
+		}
+	}
+
+	if (fold)
+	{
+		for (int ch = 0; ch < 256; ch++)
+			classes[ch] = classes[tolower(ch)];
+	}
+
+	/* Build the trie. State 0 is the root, which is never anybody's child,
+	 * so 0 also means 'no edge' for now. */
+	delta.assign(n_classes, 0);
+	match.assign(1, UINT32_MAX);
+
+	for (auto& p: patterns)
+	{
+		uint32_t state = 0;
+		for (unsigned char ch: p.first)
+		{
+			size_t edge = state * n_classes + classes[ch];
+			if (!delta[edge])
+			{
+				delta[edge] = match.size();
+				match.push_back(UINT32_MAX);
+				delta.resize(match.size() * n_classes, 0);
+			}
+			state = delta[edge];
+		}
+
+		match[state] = min(match[state], p.second);
+	}
+
+	/* Turn it into a DFA: missing edges follow the failure links, which are
+	 * resolved breadth-first so the target's edges are always complete */
+	vector<uint32_t> fail(match.size(), 0);
+	deque<uint32_t> todo;
+
+	for (size_t c = 0; c < n_classes; c++)
+	{
+		if (delta[c])
+			todo.push_back(delta[c]);
+	}
+
+	while (!todo.empty())
+	{
+		uint32_t state = todo.front();
+		todo.pop_front();
+
+		match[state] = min(match[state], match[fail[state]]);
+
+		for (size_t c = 0; c < n_classes; c++)
+		{
+			uint32_t& next = delta[state * n_classes + c];
+			uint32_t via_fail = delta[fail[state] * n_classes + c];
+
+			if (next)
+			{
+				fail[next] = via_fail;
+				todo.push_back(next);
+			}
+			else
+			{
+				next = via_fail;
+			}
+		}
+	}
+
+	delta.shrink_to_fit();
+}
+
+uint32_t banner_classifier::automaton::scan(string_view s) const
+{
+	uint32_t state = 0;
+	uint32_t best = UINT32_MAX;
+
+	for (unsigned char ch: s)
+	{
+		state = delta[state * n_classes + classes[ch]];
+		best = min(best, match[state]);
+	}
+
+	return best;
+}
+
+const string* banner_classifier::classify(string_view banner) const
+{
+	uint32_t best = UINT32_MAX;
+
+	if (!exact.empty())
+		best = exact.scan(banner);
+	if (!folded.empty())
+		best = min(best, folded.scan(banner));
+
+	return best == UINT32_MAX ? nullptr : &labels[best];
+}
@@ -0,0 +1,47 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/* Labels banners by the first signature (in file order) they contain. All
+ * signatures are compiled into one Aho-Corasick DFA, so a banner is scanned
+ * once no matter how many there are. Case-insensitive ones get a second DFA,
+ * which runs over case-folded input. */
+class banner_classifier
+{
+public:
+	bool load(const std::string& filename);
+
+	const std::string* classify(std::string_view banner) const;
+
+	size_t size() const { return labels.size(); }
+
+private:
+	struct automaton
+	{
+		/* Bytes that don't occur in any pattern all share class 0 */
+		uint16_t classes[256];
+		size_t n_classes = 0;
+
+		/* delta[state * n_classes + class] is the next state */
+		std::vector<uint32_t> delta;
+
+		/* Lowest signature ending in (or through a suffix of) each state */
+		std::vector<uint32_t> match;
+
+		void build(const std::vector<std::pair<std::string, uint32_t>>& patterns, bool fold);
+		uint32_t scan(std::string_view s) const;
+		bool empty() const { return delta.empty(); }
+	};
+
+	static bool unescape(const std::string& in, std::string& out);
+
+	automaton exact;
+	automaton folded;
+	std::vector<std::string> labels;
+};
+
+#endif /* CLASSIFY_H */
@@ -0,0 +1,357 @@
+#ifndef CONN_BACKEND_H
+#define CONN_BACKEND_H
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <cstdint>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+#include "conn_poller.h"
+#include "trace.h"
+
+/* What conn_pool does its I/O through: a socket backend for real scans, and a
+ * replay backend for running recorded traces through the pool offline. Each
+ * provides the poller the pool registers its connections with. */
+
+class socket_backend
+{
+public:
+	template <class T, class H>
+	class poller : public conn_poller<T, H>
+	{
+	public:
+		poller(H* handler, socket_backend&) : conn_poller<T, H>(handler) { }
+	};
+
+	void set_trace(std::shared_ptr<trace_writer> trace) { this->trace = trace; }
+	std::shared_ptr<trace_writer> get_trace() { return trace; }
+
+	int open_socket() { return socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0); }
+
+	int connect(int fd, const sockaddr_in& addr)
+	{
+		int ret = ::connect(fd, (const sockaddr*) &addr, sizeof(addr));
+
+		/* Connections that fail straight away never make it into the pool */
+		if (trace)
+		{
+			if ((size_t) fd >= ids.size())
+				ids.resize(fd + 1, untraced);
+
+			if (ret == 0 || errno == EINPROGRESS)
+				ids[fd] = trace->opened(addr.sin_addr.s_addr, ntohs(addr.sin_port));
+			else
+				ids[fd] = untraced;
+		}
+
+		return ret;
+	}
+
+	/* The outcome of a non-blocking connect() */
+	int get_error(int fd, int& err)
+	{
+		socklen_t optlen = sizeof(int);
+		int ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &optlen);
+
+		if (trace && ret == 0 && id(fd) != untraced)
+			trace->connected(id(fd), err);
+
+		return ret;
+	}
+
+	ssize_t read(int fd, void* buf, size_t n)
+	{
+		ssize_t ret = ::read(fd, buf, n);
+
+		if (trace && id(fd) != untraced)
+		{
+			if (ret > 0)
+				trace->data(id(fd), buf, ret);
+			else
+				trace->eof(id(fd), ret ? errno : 0);
+		}
+
+		return ret;
+	}
+
+	ssize_t write(int fd, const void* buf, size_t n) { return ::write(fd, buf, n); }
+
+	void close(int fd)
+	{
+		if (trace && id(fd) != untraced)
+		{
+			trace->closed(id(fd));
+
+			/* The fd may come back through add_fd(), as somebody else */
+			ids[fd] = untraced;
+		}
+
+		::close(fd);
+	}
+
+private:
+	static constexpr uint32_t untraced = UINT32_MAX;
+
+	/* Fds handed to the pool with add_fd() were never connect()ed here */
+	uint32_t id(int fd) { return (size_t) fd < ids.size() ? ids[fd] : untraced; }
+
+	std::shared_ptr<trace_writer> trace;
+
+	/* Trace id of the connection on each fd */
+	std::vector<uint32_t> ids;
+};
+
+/* Plays back a trace: fds are the recorded connections' ids, and reads,
+ * connects and hangups happen when feed() hands over their records.
+ * What we wrote isn't checked against anything, just swallowed. */
+class replay_backend
+{
+public:
+	template <class T, class H>
+	class poller
+	{
+	public:
+		poller(H* handler, replay_backend& backend)
+			: handler(handler), backend(backend)
+		{ }
+
+		bool add(T* data)
+		{
+			int fd = handler->get_fd(data);
+			backend.conns[fd].data = data;
+			backend.wake(fd);
+
+			return true;
+		}
+
+		bool remove(T* data)
+		{
+			backend.conns[handler->get_fd(data)].data = nullptr;
+
+			return true;
+		}
+
+		/* There are no other fds in a replay */
+		bool watch(int, uint32_t, fd_handler*)
+		{
+			errno = ENOTSUP;
+			return false;
+		}
+
+		bool unwatch(int)
+		{
+			errno = ENOENT;
+			return false;
+		}
+
+		/* Level-triggered, like epoll is used: whatever can still make
+		 * progress afterwards stays on the ready list */
+		bool poll(int, int)
+		{
+			ready.swap(backend.ready);
+
+			for (int fd: ready)
+			{
+				auto& c = backend.conns[fd];
+				c.queued = false;
+
+				if (!c.data)
+					continue;
+
+				T* data = (T*) c.data;
+				uint32_t events = handler->get_req_events(data);
+
+				bool success = true;
+				if ((events & EPOLLIN) && c.readable())
+					success &= handler->read_event(data);
+
+				if (success && (events & EPOLLOUT) && c.writable())
+					success &= handler->write_event(data);
+
+				if (success && c.data && c.pending(handler->get_req_events(data)))
+					backend.wake(fd);
+			}
+
+			ready.clear();
+
+			return true;
+		}
+
+	private:
+		H* handler;
+		replay_backend& backend;
+		std::vector<int> ready;
+	};
+
+	/* The next connect() is the trace's connection 'id' */
+	void expect(uint32_t id) { next_fd = id; }
+
+	void feed(const trace_record& r)
+	{
+		if (r.id >= conns.size())
+			return;
+
+		auto& c = conns[r.id];
+		if (c.closed)
+			return;
+
+		switch (r.type)
+		{
+			case trace_event::connect:
+				c.connect_known = true;
+				c.err = r.err;
+				break;
+			case trace_event::data:
+				c.chunks.push_back(r.data);
+				break;
+			case trace_event::eof:
+				c.eof = true;
+				c.eof_err = r.err;
+				break;
+			case trace_event::close:
+				hang_up(c);
+				break;
+			case trace_event::open:
+				break;
+		}
+
+		wake(r.id);
+	}
+
+	/* Ends whatever the trace left open, the way a timeout would have */
+	void finish()
+	{
+		for (size_t fd = 0; fd < conns.size(); fd++)
+		{
+			if (conns[fd].data && !conns[fd].closed)
+			{
+				hang_up(conns[fd]);
+				wake(fd);
+			}
+		}
+	}
+
+	int open_socket()
+	{
+		if ((size_t) next_fd >= conns.size())
+			conns.resize(next_fd + 1);
+
+		conns[next_fd] = conn();
+
+		return next_fd;
+	}
+
+	int connect(int, const sockaddr_in&) { return 0; }
+
+	int get_error(int fd, int& err)
+	{
+		err = conns[fd].err;
+
+		return 0;
+	}
+
+	ssize_t read(int fd, void* buf, size_t n)
+	{
+		auto& c = conns[fd];
+
+		if (c.head == c.chunks.size())
+		{
+			if (!c.eof)
+			{
+				errno = EAGAIN;
+				return -1;
+			}
+
+			errno = c.eof_err;
+			return c.eof_err ? -1 : 0;
+		}
+
+		std::string_view& chunk = c.chunks[c.head];
+		n = std::min(n, chunk.size());
+		memcpy(buf, chunk.data(), n);
+
+		chunk.remove_prefix(n);
+		if (chunk.empty() && ++c.head == c.chunks.size())
+		{
+			c.chunks.clear();
+			c.head = 0;
+		}
+
+		return n;
+	}
+
+	ssize_t write(int, const void*, size_t n) { return n; }
+
+	void close(int fd)
+	{
+		auto& c = conns[fd];
+
+		c.closed = true;
+		c.data = nullptr;
+		c.chunks = std::vector<std::string_view>();
+		c.head = 0;
+	}
+
+private:
+	struct conn
+	{
+		void* data = nullptr;
+		bool queued = false;
+		bool closed = false;
+
+		bool connect_known = false;
+		int err = 0;
+
+		/* Reads that haven't been taken yet start at head */
+		std::vector<std::string_view> chunks;
+		size_t head = 0;
+		bool eof = false;
+		int eof_err = 0;
+
+		bool readable() { return head < chunks.size() || eof; }
+		bool writable() { return connect_known; }
+
+		bool pending(uint32_t events)
+		{
+			return ((events & EPOLLIN) && readable()) || ((events & EPOLLOUT) && writable());
+		}
+	};
+
+	/* We hung up on it: a timeout, or the negotiator was done. Either way,
+	 * it looks the same to the pool as the connect failing, or the other
+	 * side closing. */
+	static void hang_up(conn& c)
+	{
+		if (!c.connect_known)
+		{
+			c.connect_known = true;
+			c.err = ETIMEDOUT;
+		}
+		else
+		{
+			c.eof = true;
+		}
+	}
+
+	void wake(int fd)
+	{
+		if (!conns[fd].queued)
+		{
+			conns[fd].queued = true;
+			ready.push_back(fd);
+		}
+	}
+
+	std::vector<conn> conns;
+	std::vector<int> ready;
+	int next_fd = 0;
+};
+
+#endif /* CONN_BACKEND_H */
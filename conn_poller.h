@@ -2,6 +2,7 @@
 #define CONN_POLLER_H
 
 #include <vector>
+#include <list>
 #include <sys/epoll.h>
 #include <cstdint>
 #include <errno.h>
@@ -20,11 +21,32 @@ public:
 	virtual bool write_event(T* data) = 0;
 };
 
-template <class T>
+/* Anything besides connections that wants to wait in the same epoll set,
+ * like the control socket. These events are rare, so they're virtual calls. */
+class fd_handler
+{
+public:
+	virtual ~fd_handler() { }
+
+	virtual void fd_event(int fd, uint32_t events) = 0;
+};
+
+class fd_watcher
+{
+public:
+	virtual ~fd_watcher() { }
+
+	/* Level-triggered: the handler is called for as long as the events are pending */
+	virtual bool watch(int fd, uint32_t events, fd_handler* handler) = 0;
+	virtual bool unwatch(int fd) = 0;
+};
+
+/* H is normally the (final) concrete handler, so the per-event calls can be inlined */
+template <class T, class H = poll_event_handler<T>>
 class conn_poller
 {
 public:
-	conn_poller(poll_event_handler<T>* handler)
+	conn_poller(H* handler)
 		: handler(handler)
 	{
 		epollfd = epoll_create1(0);
@@ -54,6 +76,40 @@ public:
 		return epoll_ctl(epollfd, EPOLL_CTL_ADD, handler->get_fd(data), &ev) != -1;
 	}
 
+	bool watch(int fd, uint32_t events, fd_handler* fh)
+	{
+		watched.push_back(watched_fd { fd, fh });
+
+		struct epoll_event ev;
+		ev.events = events;
+		ev.data.u64 = (uintptr_t) &watched.back() | watched_tag;
+
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		{
+			watched.pop_back();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool unwatch(int fd)
+	{
+		for (auto it = watched.begin(); it != watched.end(); ++it)
+		{
+			if (it->fd == fd)
+			{
+				/* Closing the fd takes it out of the set anyway */
+				epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+				watched.erase(it);
+				return true;
+			}
+		}
+
+		errno = ENOENT;
+		return false;
+	}
+
 	bool poll(int max_events, int timeout)
 	{
 		if (max_events > (int) events.size())
@@ -71,6 +127,14 @@ public:
 		for (int i = 0; i < n_poll; i++)
 		{
 			epoll_event& event = events[i];
+
+			if (event.data.u64 & watched_tag)
+			{
+				watched_fd* w = (watched_fd*) (uintptr_t) (event.data.u64 & ~watched_tag);
+				w->handler->fd_event(w->fd, event.events);
+				continue;
+			}
+
 			T* data = (T*) event.data.ptr;
 
 			bool success = true;
@@ -92,9 +156,19 @@ public:
 	}
 
 private:
+	struct watched_fd
+	{
+		int fd;
+		fd_handler* handler;
+	};
+
+	/* Entries are word aligned, so the lowest bit tells watched fds apart from T's */
+	static const uint64_t watched_tag = 1;
+
 	int epollfd;
-	poll_event_handler<T>* handler;
+	H* handler;
 	std::vector<epoll_event> events;
+	std::list<watched_fd> watched;
 };
 #endif /* CONN_POLLER_H */
 
@@ -13,27 +13,41 @@
 
 using namespace std;
 
-conn_pool::conn_pool()
-	: poller(conn_poller<conn_entry>(this))
+template <class B>
+basic_conn_pool<B>::basic_conn_pool()
+	: poller(this, backend)
 { }
 
-void conn_pool::check_timeouts(std::chrono::time_point<std::chrono::high_resolution_clock> ts, int ttl)
+template <class B>
+void basic_conn_pool<B>::check_timeouts(std::chrono::time_point<std::chrono::high_resolution_clock> ts,
+		int connect_timeout, int idle_timeout, int ttl)
 {
 	std::list<conn_entry>::iterator it = ces.begin();
 	while (it != ces.end())
 	{
 		/* Time to die? */
-		if (ts - it->ts >= chrono::seconds(ttl))
+		bool expired = ts - it->ts >= chrono::seconds(ttl);
+
+		/* Never got connected */
+		if (!it->connected && connect_timeout && ts - it->ts >= chrono::seconds(connect_timeout))
+			expired = true;
+
+		/* Went quiet, or never said anything since connecting */
+		if (it->connected && idle_timeout && ts - it->last_read >= chrono::seconds(idle_timeout))
+			expired = true;
+
+		if (expired)
 		{
 			auto& ce = *it;
 
 			if (it->connected)
-				new_banner(ce.ip, ce.str);
+				done(&ce);
+			else
+				fail(&ce, ETIMEDOUT);
 			poller.remove(&ce);
-			close(it->sockfd);
+			backend.close(it->sockfd);
 
-			ces.erase(it++);
-			ces_size--;
+			erase(it++);
 			continue;
 		}
 
@@ -41,34 +55,39 @@ void conn_pool::check_timeouts(std::chrono::time_point<std::chrono::high_resolut
 	}
 }
 
-int conn_pool::get_fd(conn_entry* ce)
+template <class B>
+int basic_conn_pool<B>::get_fd(conn_entry* ce)
 {
 	return ce->sockfd;
 }
 
-uint32_t conn_pool::get_req_events(conn_entry* ce)
+template <class B>
+uint32_t basic_conn_pool<B>::get_req_events(conn_entry* ce)
 {
 	uint32_t events = 0;
 
 	if (ce->connected)
 		events |= EPOLLIN;
 
-	if (!ce->connected || (ce->negot && ce->negot->has_write_data()))
+	if (!ce->connected || (ce->negot && ce->negot.has_write_data()))
 		events |= EPOLLOUT;
 
 	return events;
 }
 
-bool conn_pool::read_event(conn_entry* ce)
+template <class B>
+bool basic_conn_pool<B>::read_event(conn_entry* ce)
 {
 	unsigned char buffer[4096];
-	ssize_t n = read(ce->sockfd, buffer, sizeof(buffer));
+	ssize_t n = backend.read(ce->sockfd, buffer, sizeof(buffer));
 
 	if (n > 0)
 	{
+		ce->last_read = chrono::high_resolution_clock::now();
+
 		if (ce->negot)
 		{
-			ce->str += ce->negot->crunch(buffer, n);
+			ce->str += ce->negot.crunch(buffer, n);
 		}
 		else
 		{
@@ -79,35 +98,46 @@ bool conn_pool::read_event(conn_entry* ce)
 					ce->str += ch;
 			}
 		}
+
+		/* Cut off hosts that keep talking */
+		bool full = max_banner && ce->str.size() >= max_banner;
+		if (full)
+			ce->str.resize(max_banner);
+
+		account(ce);
+
+		/* The negotiator got what it came for, no need to wait for the other side to close */
+		if (!full && (!ce->negot || !ce->negot.finished()))
+			return true;
 	}
-	else if (ce->connected)
+	else if (!ce->connected)
 	{
-		new_banner(ce->ip, ce->str);
-		close(ce->sockfd);
+		return true;
+	}
 
-		ces.erase(ce->it);
-		ces_size--;
+	done(ce);
+	backend.close(ce->sockfd);
 
-		return false;
-	}
+	erase(ce->it);
 
-	return true;
+	return false;
 }
 
-bool conn_pool::write_event(conn_entry* ce)
+template <class B>
+bool basic_conn_pool<B>::write_event(conn_entry* ce)
 {
 	if (!ce->connected)
 	{
-		socklen_t optlen = sizeof(int);
 		int optval = -1;
-		ce->ip = getip(ce->sockfd);
-		if (getsockopt(ce->sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) == -1)
+		if (backend.get_error(ce->sockfd, optval) == -1)
 		{
-			cerr << "getsockopt() ip=" << ce->ip.c_str() << ", fd=" << ce->sockfd << ": " << strerror(errno) << '\n';
+			int err = errno;
+			cerr << "getsockopt() ip=" << ce->ip.c_str() << ", fd=" << ce->sockfd << ": " << strerror(err) << '\n';
 
+			fail(ce, err);
 			poller.remove(ce);
-			ces.erase(ce->it);
-			ces_size--;
+			backend.close(ce->sockfd);
+			erase(ce->it);
 
 			return false;
 		}
@@ -117,18 +147,25 @@ bool conn_pool::write_event(conn_entry* ce)
 			total_connections++;
 			ce->connected = true;
 
+			/* Idle time counts from here until the first read */
+			ce->last_read = chrono::high_resolution_clock::now();
+
 			/* Bring in the negotiator? */
 			if (prov)
-				ce->negot = prov->provide(ce->sockfd);
+			{
+				coro_arena::scope scope(arena);
+				prov->provide(ce->negot, ce->sockfd);
+				account(ce);
+			}
 
 			return true;
 		}
 		else
 		{
+			fail(ce, optval);
 			poller.remove(ce);
-			close(ce->sockfd);
-			ces.erase(ce->it);
-			ces_size--;
+			backend.close(ce->sockfd);
+			erase(ce->it);
 
 			return false;
 		}
@@ -136,18 +173,18 @@ bool conn_pool::write_event(conn_entry* ce)
 
 
 	/* Do we have shit to write? */
-	if (ce->connected && (ce->negot && ce->negot->has_write_data()))
+	if (ce->connected && (ce->negot && ce->negot.has_write_data()))
 	{
-		auto data_vector = ce->negot->pop_write_queue();
-		ssize_t n = write(ce->sockfd, data_vector.data(), data_vector.size());
+		auto data_vector = ce->negot.pop_write_queue();
+		account(ce);
+		ssize_t n = backend.write(ce->sockfd, data_vector.data(), data_vector.size());
 		if (n <= 0)
 		{
-			new_banner(ce->ip, ce->str);
+			done(ce);
 			poller.remove(ce);
-			close(ce->sockfd);
+			backend.close(ce->sockfd);
 
-			ces.erase(ce->it);
-			ces_size--;
+			erase(ce->it);
 
 			return false;
 		}
@@ -156,47 +193,164 @@ bool conn_pool::write_event(conn_entry* ce)
 	return true;
 }
 
-char* conn_pool::getip(int fd)
+template <class B>
+conn_result basic_conn_pool<B>::result(conn_entry* ce)
 {
-	struct sockaddr_in addr;
-	socklen_t addr_size = sizeof(addr);
-	getpeername(fd, (struct sockaddr*) &addr, &addr_size);
-	return inet_ntoa(addr.sin_addr);
+	return conn_result { ce->ip, ce->str, string_view(), ce->port, ce->attempt, ce->tag,
+		chrono::high_resolution_clock::now() - ce->ts };
 }
 
-void conn_pool::add_fd(int fd)
+template <class B>
+void basic_conn_pool<B>::done(conn_entry* ce)
 {
-	conn_entry ce;
-	ce.sockfd = fd;
-	ce.ts =  chrono::high_resolution_clock::now();
-	ce.connected = false;
+	if (!new_banner)
+		return;
+
+	conn_result r = result(ce);
+
+	if (classifier)
+	{
+		const string* label = classifier->classify(r.banner);
+		if (label)
+			r.label = *label;
+	}
+
+	new_banner(r);
+}
+
+template <class B>
+void basic_conn_pool<B>::fail(conn_entry* ce, int err)
+{
+	if (conn_failed)
+		conn_failed(result(ce), err);
+}
+
+template <class B>
+bool basic_conn_pool<B>::connect(const string& host, int port, int attempt, uint64_t tag)
+{
+	int sockfd;
+	struct sockaddr_in addr;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		return false;
+
+	sockfd = backend.open_socket();
+	if (sockfd == -1)
+	{
+		perror("\nsocket()");
+		return false;
+	}
+
+	if (backend.connect(sockfd, addr) == -1 &&
+			errno != EINPROGRESS)
+	{
+		int err = errno;
+		perror("\nconnect()");
+		backend.close(sockfd);
 
-	ces.push_back(ce);
+		/* Unreachable routes and the like are worth retrying too */
+		if (conn_failed)
+			conn_failed(conn_result { host, string_view(), string_view(), port, attempt, tag,
+					chrono::high_resolution_clock::duration::zero() }, err);
 
-	auto& back = ces.back();
+		return false;
+	}
+
+	add_fd(sockfd, host, port, attempt, tag);
+
+	return true;
+}
+
+template <class B>
+void basic_conn_pool<B>::add_fd(int fd, string ip, int port, int attempt, uint64_t tag)
+{
+	auto& back = ces.emplace_back();
+	back.sockfd = fd;
+	back.ts =  chrono::high_resolution_clock::now();
+	back.connected = false;
+	back.port = port;
+	back.attempt = attempt;
+	back.tag = tag;
+	back.ip = ip;
+	back.mem = 0;
 
 	/* Keep an iterater to ourself */
 	back.it = std::prev(ces.end());
 
+	account(&back);
+
 	/* Add the connection to the kernel's list of interest */
 	poller.add(&back);
 
 	ces_size++;
 }
 
-void conn_pool::check_sockets(int timeout)
+template <class B>
+void basic_conn_pool<B>::account(conn_entry* ce)
+{
+	size_t mem = sizeof(conn_entry) + ce->ip.capacity() + ce->str.capacity() + ce->negot.buffered();
+
+	mem_usage += mem - ce->mem;
+	ce->mem = mem;
+}
+
+template <class B>
+void basic_conn_pool<B>::erase(list<conn_entry>::iterator it)
+{
+	mem_usage -= it->mem;
+
+	ces.erase(it);
+	ces_size--;
+}
+
+template <class B>
+bool basic_conn_pool<B>::get_min_tag(uint64_t& tag)
+{
+	if (ces.empty())
+		return false;
+
+	tag = UINT64_MAX;
+	for (auto& ce: ces)
+		tag = min(tag, ce.tag);
+
+	return true;
+}
+
+template <class B>
+void basic_conn_pool<B>::check_sockets(int timeout)
 {
 	/* Anything left? */
-	if (!ces_size)
+	if (!ces_size && !watched)
 		return;
 
-	if (ces_size > events.size())
-		events.resize(ces_size);
-
-	if (!poller.poll(ces_size, timeout))
+	if (!poller.poll(ces_size + watched, timeout))
 	{
 		cerr << "poller: " << strerror(errno) << '\n';
 		exit(1);
 	}
 }
 
+template <class B>
+bool basic_conn_pool<B>::watch(int fd, uint32_t events, fd_handler* handler)
+{
+	if (!poller.watch(fd, events, handler))
+		return false;
+
+	watched++;
+	return true;
+}
+
+template <class B>
+bool basic_conn_pool<B>::unwatch(int fd)
+{
+	if (!poller.unwatch(fd))
+		return false;
+
+	watched--;
+	return true;
+}
+
+template class basic_conn_pool<socket_backend>;
+template class basic_conn_pool<replay_backend>;
@@ -7,43 +7,106 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include "negotiator.h"
+#include "negotiator_slot.h"
+#include "coro.h"
 #include "conn_poller.h"
+#include "conn_backend.h"
+#include "classify.h"
 
 struct conn_entry
 {
 	int sockfd;
 	std::chrono::time_point<std::chrono::high_resolution_clock> ts;
+
+	/* Last data received, or when the connect completed */
+	std::chrono::time_point<std::chrono::high_resolution_clock> last_read;
+
 	bool connected;
+	int port;
+	int attempt;
+	uint64_t tag;
+
+	/* Bytes held by this entry, as last accounted */
+	size_t mem;
+
 	std::string ip;
 	std::string str;
 
-	std::shared_ptr<negotiator> negot;
+	negotiator_slot negot;
 
 	/* Keep an iterator to ourself, in order to do fast removal of entries from the list */
 	std::list<conn_entry>::iterator it;
 };
 
-class conn_pool : private poll_event_handler<conn_entry>
+/* What a finished (or failed) connection is reported as. The views point into the
+ * connection's own buffers, and are only valid for the duration of the callback. */
+struct conn_result
+{
+	std::string_view host;
+	std::string_view banner;
+
+	/* The matching signature's label, empty if there's none (or no classifier) */
+	std::string_view label;
+
+	int port;
+	int attempt;
+
+	/* Whatever the caller passed in with the target, e.g. its position in the input */
+	uint64_t tag;
+
+	std::chrono::high_resolution_clock::duration elapsed;
+};
+
+/* B is the backend that does the I/O, see conn_backend.h */
+template <class B>
+class basic_conn_pool final : private poll_event_handler<conn_entry>, public fd_watcher
 {
+	/* The poller calls straight into us, rather than through poll_event_handler */
+	friend class conn_poller<conn_entry, basic_conn_pool>;
+	friend typename B::template poller<conn_entry, basic_conn_pool>;
+
 public:
-	conn_pool();
+	basic_conn_pool();
+
+	B& get_backend() { return backend; }
 
 	int get_total_connections() { return total_connections; }
 	size_t get_queue_size() { return ces_size; }
+	/* Connections, plus the chunks their negotiators' coroutine frames come from */
+	size_t get_mem_usage() { return mem_usage + arena.get_in_use(); }
+
+	void set_max_banner(size_t max_banner) { this->max_banner = max_banner; }
+	size_t get_max_banner() { return max_banner; }
+
+	void set_new_banner(std::function<void(const conn_result& result)> new_banner) { this->new_banner = new_banner; }
+	std::function<void(const conn_result& result)> get_new_banner() { return new_banner; }
 
-	void set_new_banner(std::function<void(std::string host, std::string banner)> new_banner) { this->new_banner = new_banner; }
-	std::function<void(std::string host, std::string banner)> get_new_banner() { return new_banner; }
+	void set_conn_failed(std::function<void(const conn_result& result, int err)> conn_failed) { this->conn_failed = conn_failed; }
+	std::function<void(const conn_result& result, int err)> get_conn_failed() { return conn_failed; }
 
 	void set_prov(std::shared_ptr<negotiator_provider> prov) { this->prov = prov; }
 	std::shared_ptr<negotiator_provider> get_prov() { return prov; }
 
+	void set_classifier(std::shared_ptr<banner_classifier> classifier) { this->classifier = classifier; }
+	std::shared_ptr<banner_classifier> get_classifier() { return classifier; }
+
+	/* Waits for the connections, and any other fds that are watched */
 	void check_sockets(int timeout);
 
-	void add_fd(int fd);
+	bool watch(int fd, uint32_t events, fd_handler* handler) override;
+	bool unwatch(int fd) override;
+
+	bool connect(const std::string& host, int port, int attempt = 0, uint64_t tag = 0);
+	void add_fd(int fd, std::string ip, int port, int attempt = 0, uint64_t tag = 0);
+
+	bool get_min_tag(uint64_t& tag);
 
-	void check_timeouts(std::chrono::time_point<std::chrono::high_resolution_clock> ts, int ttl);
+	void check_timeouts(std::chrono::time_point<std::chrono::high_resolution_clock> ts,
+			int connect_timeout, int idle_timeout, int ttl);
 
 private:
 	int get_fd(conn_entry* ce) override;
@@ -51,19 +114,33 @@ private:
 	bool read_event(conn_entry* ce) override;
 	bool write_event(conn_entry* ce) override;
 
-	char* getip(int fd);
+	void account(conn_entry* ce);
+	void erase(std::list<conn_entry>::iterator it);
+	void done(conn_entry* ce);
+	void fail(conn_entry* ce, int err);
+	static conn_result result(conn_entry* ce);
 
-	std::function<void(std::string host, std::string banner)> new_banner;
+	std::function<void(const conn_result& result)> new_banner;
+	std::function<void(const conn_result& result, int err)> conn_failed;
 	int total_connections = 0;
 	std::shared_ptr<negotiator_provider> prov = nullptr;
-	std::vector<epoll_event> events;
+	std::shared_ptr<banner_classifier> classifier = nullptr;
 
-	conn_poller<conn_entry> poller;
+	B backend;
+	typename B::template poller<conn_entry, basic_conn_pool> poller;
+
+	/* Where negotiators' coroutine frames come from. Declared ahead of ces,
+	 * so that it outlives them. */
+	coro_arena arena;
 
 	std::list<conn_entry> ces;
 	size_t ces_size = 0;
-	int maxfd = -1;
+	size_t watched = 0;
+	size_t mem_usage = 0;
+	size_t max_banner = 0;
 };
 
+typedef basic_conn_pool<socket_backend> conn_pool;
+
 
 #endif /* CONN_POOL_H */
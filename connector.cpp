@@ -10,46 +10,212 @@
 #include <string.h>
 #include <fcntl.h>
 #include <iomanip>
+#include <thread>
+#include <sstream>
+#include <algorithm>
 
 #include "connector.h"
 #include "telnet.h"
+#include "atomic_write.h"
+#include "hash.h"
 
 using namespace std;
 
 connector::connector(istream& input, ostream& output, int port)
 	: input(input), output(output), port(port)
 {
-	pool.set_new_banner(bind(&connector::write_to_file, this, placeholders::_1, placeholders::_2));
+	pool.set_new_banner(bind(&connector::write_to_file, this, placeholders::_1));
+	pool.set_conn_failed(bind(&connector::conn_failed, this, placeholders::_1, placeholders::_2));
 }
 
-int connector::newcon(const char* host, int port)
+bool connector::launch(const string& host, int attempt, uint64_t tag)
 {
-	int sockfd;
-	struct sockaddr_in addr;
+	return pool.connect(host, port, attempt, tag);
+}
+
+bool connector::owns(const string& host)
+{
+	if (shards <= 1)
+		return true;
+
+	/* Hash the address rather than the text, so the split doesn't depend on formatting */
+	uint64_t h;
+	struct in_addr addr;
+	if (inet_pton(AF_INET, host.c_str(), &addr) == 1)
+		h = (fnv1a_basis ^ ntohl(addr.s_addr)) * fnv1a_prime;
+	else
+		h = fnv1a(host);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+
+	return (int) (h % shards) == shard;
+}
+
+bool connector::set_exclude_file(const string& exclude_file)
+{
+	this->exclude_file = exclude_file;
+
+	return reload_exclude();
+}
+
+bool connector::reload_exclude()
+{
+	reload_pending = false;
+
+	/* Only replace the list once the new one has loaded completely */
+	auto loaded = make_shared<cidr_set>();
+	if (!loaded->load(exclude_file))
+		return false;
+
+	exclude = loaded;
+
+	return true;
+}
+
+connector::~connector()
+{
+	/* The control socket may outlive the pool it's watched by */
+	if (control)
+		control->detach();
+}
+
+bool connector::set_control(shared_ptr<control_socket> control)
+{
+	if (this->control)
+		this->control->detach();
+
+	this->control = control;
+	if (!control)
+		return true;
+
+	control->set_handler(bind(&connector::command, this, placeholders::_1));
+
+	return control->attach(&pool);
+}
+
+uint64_t connector::resume_offset()
+{
+	/* Everything before the oldest target that's still in flight is done */
+	uint64_t offset = skip + total_lines;
+	uint64_t tag;
+
+	if (pool.get_min_tag(tag))
+		offset = min(offset, tag);
+	if (retries.get_min_tag(tag))
+		offset = min(offset, tag);
+	if (prescan && prescan->get_min_tag(tag))
+		offset = min(offset, tag);
+
+	return offset;
+}
+
+bool connector::write_checkpoint()
+{
+	uint64_t offset = resume_offset();
+
+	return atomic_write(checkpoint_file, [&](ostream& out) {
+		out << "port=" << port << '\n';
+		if (shards > 1)
+			out << "shard=" << shard << '/' << shards << '\n';
+		out << "skip=" << offset << '\n';
+	});
+}
+
+string connector::command(const string& cmd)
+{
+	istringstream in(cmd);
+	string op;
+	in >> op;
 
-	sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-	if (sockfd == -1)
+	if (op == "stats")
 	{
-		perror("\nsocket()");
-		return -1;
+		ostringstream out;
+		out << "lines=" << total_lines
+		    << " connections=" << pool.get_total_connections()
+		    << " in_progress=" << pool.get_queue_size()
+		    << " awaiting_retry=" << retries.size();
+		if (prescan)
+			out << " open=" << prescan->get_total_open();
+		if (exclude)
+			out << " excluded=" << total_excluded << " exclude_ranges=" << exclude->size();
+		if (dedup)
+			out << " duplicates=" << total_duplicates << " dedup_bytes=" << dedup->get_memory_usage();
+		out << " mem=" << pool.get_mem_usage()
+		    << " mem_limit=" << mem_limit
+		    << " resume=" << resume_offset()
+		    << " maxcon=" << maxcon
+		    << " rate=" << conn_rate
+		    << " ttl=" << ttl
+		    << " connect_timeout=" << connect_timeout
+		    << " idle_timeout=" << idle_timeout
+		    << " paused=" << paused
+		    << " running=" << running;
+
+		return out.str();
 	}
 
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(port);
-	if (inet_pton(AF_INET, host, &addr.sin_addr) == -1)
+	if (op == "set")
 	{
-		perror("\ninet_pton()");
-		return -1;
+		string name;
+		long value;
+		if (!(in >> name >> value) || value < 0)
+			return "error: usage: set <name> <value>";
+
+		if (name == "maxcon" && value > 0)
+			set_maxcon(value);
+		else if (name == "rate" && value > 0)
+			set_conn_rate(value);
+		else if (name == "ttl" && value > 0)
+			set_ttl(value);
+		else if (name == "connect_timeout")
+			set_connect_timeout(value);
+		else if (name == "idle_timeout")
+			set_idle_timeout(value);
+		else
+			return "error: can't set " + name + " to " + to_string(value);
+
+		return "ok";
 	}
 
-	if (connect(sockfd, (struct sockaddr*) &addr, sizeof(struct sockaddr)) == -1 &&
-			errno != EINPROGRESS)
+	if (op == "pause" || op == "resume")
 	{
-		perror("\nconnect()");
-		return -1;
+		paused = op == "pause";
+		return "ok";
 	}
 
-	return sockfd;
+	if (op == "reload")
+	{
+		if (exclude_file.empty())
+			return "error: no exclude file set";
+
+		if (!reload_exclude())
+			return string("error: ") + strerror(errno);
+
+		return "ok ranges=" + to_string(exclude->size());
+	}
+
+	if (op == "checkpoint")
+	{
+		if (checkpoint_file.empty())
+			return "error: no checkpoint file set";
+
+		if (!write_checkpoint())
+			return string("error: ") + strerror(errno);
+
+		return "ok skip=" + to_string(resume_offset());
+	}
+
+	return "error: unknown command \"" + op + "\"";
+}
+
+bool connector::over_budget()
+{
+	/* Stop taking in new targets a bit before the limit, since the ones in
+	 * flight can still grow. With none in flight, nothing would ever bring
+	 * the usage down again, so carry on. */
+	return mem_limit && pool.get_queue_size() && pool.get_mem_usage() >= mem_limit / 10 * 9;
 }
 
 void connector::die()
@@ -64,12 +230,71 @@ void connector::cont()
 	cont_start = chrono::high_resolution_clock::now();
 }
 
+void connector::poll(int timeout)
+{
+	/* Don't sleep past the next retry, as long as there's a slot for it */
+	int due = retries.next_due_ms(chrono::high_resolution_clock::now());
+	if (running && due >= 0 && due < timeout && pool.get_queue_size() < maxcon)
+		timeout = due;
+
+	/* The control socket waits in the pool's epoll set, along with the connections */
+	bool pool_busy = pool.get_queue_size() || control;
+
+	if (!prescan)
+	{
+		if (pool_busy)
+			pool.check_sockets(timeout);
+		else
+			this_thread::sleep_for(chrono::milliseconds(timeout));
+		return;
+	}
+
+	/* The raw socket isn't part of the pool, so don't block on either for long */
+	timeout = min(timeout, 10);
+
+	if (pool_busy)
+	{
+		pool.check_sockets(timeout);
+		prescan->check_responses();
+	}
+	else if (!prescan->wait(timeout))
+	{
+		perror("\npoll()");
+		exit(1);
+	}
+}
+
 void connector::print_stats()
 {
+	/* Don't leave our formatting behind for whoever prints next */
+	ios::fmtflags flags = cerr.flags();
+	streamsize precision = cerr.precision();
+
 	cerr << "\033[1G"
 	     << total_lines << " lines read, "
 	     << pool.get_total_connections() << " total connections, "
-	     << pool.get_queue_size() << " in progress";
+	     << pool.get_queue_size() << " in progress, "
+	     << std::fixed << std::setprecision(1) << pool.get_mem_usage() / 1048576.0 << " MB held";
+
+	cerr.flags(flags);
+
+	if (over_budget())
+		cerr << " (over budget)";
+
+	if (prescan)
+		cerr << ", " << prescan->get_total_open() << " open";
+
+	if (retries.get_max_retries())
+		cerr << ", " << retries.size() << " awaiting retry";
+
+	if (exclude)
+		cerr << ", " << total_excluded << " excluded";
+
+	if (dedup)
+		cerr << ", " << total_duplicates << " duplicates";
+
+	if (index)
+		cerr << ", " << index->get_unchanged() << " unchanged";
 
 	if (insize > 0 && running && input)
 	{
@@ -79,8 +304,13 @@ void connector::print_stats()
 	else if (!running)
 		cerr << " -- closing...";
 
+	if (paused && running)
+		cerr << " -- paused";
+
 	cerr << "\033[K"
 	     << flush;
+
+	cerr.precision(precision);
 }
 
 void connector::run()
@@ -88,6 +318,8 @@ void connector::run()
 	running = true;
 
 	cont_start = chrono::high_resolution_clock::now();
+	run_start = cont_start;
+	time_to_full = chrono::duration<double>(-1);
 	auto last_stat = cont_start - chrono::milliseconds(250);
 	auto last_cont = cont_start;
 
@@ -116,8 +348,12 @@ void connector::run()
 			return;
 	}
 
-	while ((input && running) || pool.get_queue_size())
+	/* Once killed, retries that are still waiting are left to the resume offset */
+	while ((input && running) || pool.get_queue_size() || (prescan && prescan->busy()) || (running && retries.size()))
 	{
+		if (reload_pending && !reload_exclude())
+			cerr << "\nCould not reload " << exclude_file << ": " << strerror(errno) << '\n';
+
 		auto now = chrono::high_resolution_clock::now();
 
 		if (now - last_cont >= chrono::milliseconds(1000))
@@ -127,7 +363,7 @@ void connector::run()
 			last_cont = now;
 
 			/* Check for connections that are past their time to live */
-			pool.check_timeouts(now, ttl);
+			pool.check_timeouts(now, connect_timeout, idle_timeout, ttl);
 		}
 
 #if 1
@@ -138,25 +374,89 @@ void connector::run()
 		}
 #endif
 
-		if (running && pool.get_queue_size() < maxcon && getline(input, s))
+		string host;
+		int attempt;
+		uint64_t tag;
+
+		/* Open as many connections as there are free slots, and as the rate allows */
+		long budget = (long) (chrono::duration<double>(now - cont_start).count() * conn_rate) + 1 - total_lines_cont;
+		while (budget > 0)
 		{
-			int sockfd = newcon(s.c_str(), port);
-			if (sockfd == -1)
+			/* Retries that are due take their slot before new targets do */
+			if (over_budget())
+				break;
+
+			if (running && pool.get_queue_size() < maxcon && retries.pop_due(now, host, attempt, tag))
+			{
+				launch(host, attempt, tag);
+				total_lines_cont++;
+				budget--;
+				continue;
+			}
+
+			/* With a pre-scan, lines turn into SYN probes, and the open hosts queue up */
+			size_t intake = prescan ? prescan->get_open_count() : pool.get_queue_size();
+
+			if (!running || paused || intake >= maxcon || !getline(input, s))
+				break;
+
+			/* Targets are tagged with their line number, to know where to resume */
+			tag = skip + total_lines++;
+
+			/* Belongs to another node, but still counts towards the resume offset */
+			if (!owns(s))
 				continue;
 
-			pool.add_fd(sockfd);
+			if (exclude && exclude->contains(s))
+			{
+				total_excluded++;
+				continue;
+			}
+
+			if (dedup && dedup->test_and_set(s))
+			{
+				total_duplicates++;
+				continue;
+			}
+
+			if (index)
+			{
+				struct in_addr addr;
+				if (inet_pton(AF_INET, s.c_str(), &addr) == 1)
+					index->attempted(ntohl(addr.s_addr));
+			}
+
+			if (prescan)
+			{
+				if (!prescan->probe(s.c_str(), tag))
+					continue;
+			}
+			else if (!launch(s, 0, tag))
+				continue;
 
-			total_lines++;
 			total_lines_cont++;
+			budget--;
 		}
 
-		for(;pool.get_queue_size() > 0;)
+		/* Only hosts that answered the SYN sweep get a full connection. They
+		 * wait in the open queue while we're over budget, same as new lines. */
+		if (prescan)
+		{
+			while (pool.get_queue_size() < maxcon && !over_budget() && prescan->pop_open(host, tag))
+				launch(host, 0, tag);
+		}
+
+		if (time_to_full < chrono::duration<double>::zero() && pool.get_queue_size() >= maxcon)
+			time_to_full = chrono::high_resolution_clock::now() - run_start;
+
+		for(;pool.get_queue_size() > 0 || (prescan && prescan->busy()) || (running && (retries.size() || input));)
 		{
 			auto poll_start = chrono::high_resolution_clock::now();
 
-			if (pool.get_queue_size() == maxcon)
+			size_t intake = prescan ? prescan->get_open_count() : pool.get_queue_size();
+			if (!running || paused || !input || intake >= maxcon || over_budget())
 			{
-				pool.check_sockets(1000);
+				poll(1000);
 				break;
 			}
 
@@ -171,7 +471,7 @@ void connector::run()
 			auto wait_ms = chrono::duration_cast<chrono::milliseconds>(wait).count();
 
 			/* Finally, do the polling */
-			pool.check_sockets(wait_ms >= 0 ? wait_ms : 0);
+			poll(wait_ms >= 0 ? wait_ms : 0);
 
 			/* If the wait time was less than a millisecond, we're done for now */
 			if (wait_ms < 1)
@@ -183,20 +483,83 @@ void connector::run()
 
 	cerr << '\n';
 
+	if (time_to_full >= chrono::duration<double>::zero())
+		cerr << "Reached " << maxcon << " concurrent connections after " << time_to_full.count() << "s\n";
+
+	/* Targets that were still in flight when killed are marked too, but would
+	 * have to be scanned again when resuming */
+	if (dedup && !dedup_file.empty())
+	{
+		if (!running)
+			cerr << "Scan was interrupted, not updating " << dedup_file << '\n';
+		else if (!dedup->save(dedup_file, port))
+			cerr << "Could not write " << dedup_file << ": " << strerror(errno) << '\n';
+	}
+
+	/* Only a complete scan can tell which hosts are gone */
+	if (index)
+	{
+		if (!running)
+		{
+			cerr << "Scan was interrupted, not reporting disappeared hosts or updating " << index_file << '\n';
+		}
+		else
+		{
+			index->for_each_gone([&](uint32_t addr) {
+				struct in_addr in;
+				in.s_addr = htonl(addr);
+				output << "- " << inet_ntoa(in) << '\n';
+			});
+			output.flush();
+
+			if (!index->save(index_file, port))
+				cerr << "Could not write " << index_file << ": " << strerror(errno) << '\n';
+		}
+	}
+
+	if (!checkpoint_file.empty() && !write_checkpoint())
+		cerr << "Could not write " << checkpoint_file << ": " << strerror(errno) << '\n';
+
 	if (!running)
 	{
 		cerr << "To continue the scan where we left off, "
 			"add these command-line options: -a -s "
-		       	<< (skip + total_lines) << '\n';
+		       	<< resume_offset() << '\n';
 	}
 }
 
-void connector::write_to_file(string host, string banner)
+void connector::conn_failed(const conn_result& result, int err)
 {
+	retries.schedule(string(result.host), result.attempt, result.tag, err);
+}
+
+void connector::write_to_file(const conn_result& result)
+{
+	/* With an index from the last scan, only changes are worth writing down */
+	const char* prefix = "";
+	if (index)
+	{
+		struct in_addr addr;
+		if (inet_pton(AF_INET, string(result.host).c_str(), &addr) == 1)
+		{
+			switch (index->update(ntohl(addr.s_addr), result.banner))
+			{
+				case banner_index::change::added: prefix = "+ "; break;
+				case banner_index::change::changed: prefix = "~ "; break;
+				case banner_index::change::unchanged: return;
+			}
+		}
+	}
+
 	if (to_terminal)
 		output << ("\033[1G\033[K");
 
-	output << host << ": " << escape(banner) << '\n';
+	output << prefix << result.host;
+	if (!result.label.empty())
+		output << " [" << result.label << ']';
+	output << ": ";
+	write_escaped(output, result.banner);
+	output << '\n';
 
 	if (to_terminal)
 		print_stats();
@@ -204,41 +567,39 @@ void connector::write_to_file(string host, string banner)
 		output.flush();
 }
 
-string connector::escape(string s)
+void connector::write_escaped(ostream& out, string_view s)
 {
-	string out;
-
-	for (char& ch: s)
+	/* Runs of printable characters go out in one piece */
+	size_t start = 0;
+	for (size_t i = 0; i < s.size(); i++)
 	{
+		char ch = s[i];
 		if (isprint(ch))
+			continue;
+
+		out.write(s.data() + start, i - start);
+		start = i + 1;
+
+		switch (ch)
 		{
-			out += ch;
-		}
-		else
-		{
-			switch (ch)
-			{
-				case '\\': out+= "\\\\"; break;
-				case '\a': out+= "\\a"; break;
-				case '\b': out+= "\\b"; break;
-				case '\f': out+= "\\f"; break;
-				case '\n': out+= "\\n"; break;
-				case '\r': out+= "\\r"; break;
-				case '\v': out+= "\\v"; break;
-
-				/* Chars to print as-is */
-				case '\t':
-					   out+= ch;
-					   break;
-				default:
-					   out += "\\x";
-					   const char* hex = "0123456789abcdef";
-					   out += hex[(unsigned char) ch >> 4];
-					   out += hex[ch & 0x0f];
-					   break;
-			}
+			case '\\': out << "\\\\"; break;
+			case '\a': out << "\\a"; break;
+			case '\b': out << "\\b"; break;
+			case '\f': out << "\\f"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\v': out << "\\v"; break;
+
+			/* Chars to print as-is */
+			case '\t':
+				   out << ch;
+				   break;
+			default:
+				   const char* hex = "0123456789abcdef";
+				   out << "\\x" << hex[(unsigned char) ch >> 4] << hex[ch & 0x0f];
+				   break;
 		}
 	}
 
-	return out;
+	out.write(s.data() + start, s.size() - start);
 }
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <string_view>
 #include <sys/epoll.h>
 #include <cstdint>
 #include <errno.h>
@@ -12,11 +13,18 @@
 #include "negotiator.h"
 #include "conn_poller.h"
 #include "conn_pool.h"
+#include "syn_scan.h"
+#include "retry.h"
+#include "control.h"
+#include "exclude.h"
+#include "dedup.h"
+#include "rescan.h"
 
 class connector
 {
 public:
 	connector(std::istream& input, std::ostream& output, int port);
+	~connector();
 
 	void run();
 	void die();
@@ -34,21 +42,102 @@ public:
 	inline void set_ttl(int ttl) { this->ttl = ttl; }
 	inline int get_ttl() { return ttl; }
 
+	inline void set_connect_timeout(int connect_timeout) { this->connect_timeout = connect_timeout; }
+	inline int get_connect_timeout() { return connect_timeout; }
+
+	inline void set_idle_timeout(int idle_timeout) { this->idle_timeout = idle_timeout; }
+	inline int get_idle_timeout() { return idle_timeout; }
+
 	inline void set_conn_rate(int conn_rate) { this->conn_rate = conn_rate; }
 	inline int get_conn_rate() { return conn_rate; }
 
+	inline void set_max_retries(int max_retries) { retries.set_max_retries(max_retries); }
+	inline int get_max_retries() { return retries.get_max_retries(); }
+
+	inline void set_backoff_ms(int backoff_ms) { retries.set_backoff_ms(backoff_ms); }
+	inline int get_backoff_ms() { return retries.get_backoff_ms(); }
+
+	inline void set_shard(int shard, int shards) { this->shard = shard; this->shards = shards; }
+	inline int get_shard() { return shard; }
+	inline int get_shards() { return shards; }
+
+	inline void set_mem_limit(size_t mem_limit) { this->mem_limit = mem_limit; }
+	inline size_t get_mem_limit() { return mem_limit; }
+
+	inline void set_max_banner(size_t max_banner) { pool.set_max_banner(max_banner); }
+	inline size_t get_max_banner() { return pool.get_max_banner(); }
+
+	inline std::chrono::duration<double> get_time_to_full() { return time_to_full; }
+
+	inline void set_paused(bool paused) { this->paused = paused; }
+	inline bool get_paused() { return paused; }
+
+	inline void set_checkpoint_file(std::string checkpoint_file) { this->checkpoint_file = checkpoint_file; }
+	inline std::string get_checkpoint_file() { return checkpoint_file; }
+
+	bool set_exclude_file(const std::string& exclude_file);
+	inline std::string get_exclude_file() { return exclude_file; }
+	bool reload_exclude();
+	inline void request_reload() { reload_pending = true; }
+
+	inline void set_dedup(std::shared_ptr<addr_bitmap> dedup) { this->dedup = dedup; }
+	inline std::shared_ptr<addr_bitmap> get_dedup() { return dedup; }
+
+	inline void set_dedup_file(std::string dedup_file) { this->dedup_file = dedup_file; }
+	inline std::string get_dedup_file() { return dedup_file; }
+
+	inline void set_index(std::shared_ptr<banner_index> index) { this->index = index; }
+	inline std::shared_ptr<banner_index> get_index() { return index; }
+
+	inline void set_index_file(std::string index_file) { this->index_file = index_file; }
+	inline std::string get_index_file() { return index_file; }
+
+	bool set_control(std::shared_ptr<control_socket> control);
+	inline std::shared_ptr<control_socket> get_control() { return control; }
+
+	std::string command(const std::string& cmd);
+
+	/* Banners as they appear in the output: one line, non-printables escaped */
+	static void write_escaped(std::ostream& out, std::string_view s);
+	uint64_t resume_offset();
+	bool write_checkpoint();
+
 	inline void set_prov(std::shared_ptr<negotiator_provider> prov) { pool.set_prov(prov); }
 	inline std::shared_ptr<negotiator_provider> get_prov() { return pool.get_prov(); }
 
+	inline void set_classifier(std::shared_ptr<banner_classifier> classifier) { pool.set_classifier(classifier); }
+	inline std::shared_ptr<banner_classifier> get_classifier() { return pool.get_classifier(); }
+
+	inline void set_trace(std::shared_ptr<trace_writer> trace) { pool.get_backend().set_trace(trace); }
+	inline std::shared_ptr<trace_writer> get_trace() { return pool.get_backend().get_trace(); }
+
+	inline void set_prescan(std::shared_ptr<syn_scanner> prescan) { this->prescan = prescan; }
+	inline std::shared_ptr<syn_scanner> get_prescan() { return prescan; }
+
 private:
 	conn_pool pool;
 
-	int newcon(const char* host, int port);
+	bool launch(const std::string& host, int attempt, uint64_t tag);
+	bool owns(const std::string& host);
+	bool over_budget();
+	void poll(int timeout);
 	void print_stats();
-	void write_to_file(std::string host, std::string banner);
-	static std::string escape(std::string s);
+	void write_to_file(const conn_result& result);
+	void conn_failed(const conn_result& result, int err);
 	void epoll_conn(conn_entry& ce, int op);
 
+	std::shared_ptr<syn_scanner> prescan = nullptr;
+	retry_queue retries;
+	std::shared_ptr<control_socket> control = nullptr;
+	std::string checkpoint_file;
+	std::shared_ptr<cidr_set> exclude = nullptr;
+	std::string exclude_file;
+	std::atomic<bool> reload_pending { false };
+	std::shared_ptr<addr_bitmap> dedup = nullptr;
+	std::string dedup_file;
+	std::shared_ptr<banner_index> index = nullptr;
+	std::string index_file;
+
 	std::istream& input;
 	std::ostream& output;
 	std::streampos insize;
@@ -58,13 +147,25 @@ private:
 	int skip = 0;
 	size_t maxcon = 10;
 	int ttl = 60;
+	int connect_timeout = 0;
+	int idle_timeout = 0;
 	int conn_rate = 1;
+	int shard = 0;
+	int shards = 1;
+	size_t mem_limit = 0;
 
 	std::atomic<bool> running;
+	bool paused = false;
 	int total_lines = 0;
 	int total_lines_cont = 0;
+	int total_excluded = 0;
+	int total_duplicates = 0;
 
 	std::chrono::time_point<std::chrono::high_resolution_clock> cont_start;
+	std::chrono::time_point<std::chrono::high_resolution_clock> run_start;
+
+	/* How long it took to first have all slots in use, negative if that never happened */
+	std::chrono::duration<double> time_to_full;
 };
 
 #endif /* CONNECTOR_H */
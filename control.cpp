@@ -0,0 +1,144 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+using namespace std;
+
+control_socket::control_socket(const string& path)
+	: path(path)
+{
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw ENAMETOOLONG;
+
+	listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listenfd == -1)
+		throw errno;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+
+	/* A stale socket from a previous run would make bind() fail */
+	unlink(path.c_str());
+
+	if (bind(listenfd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+			listen(listenfd, 4) == -1)
+	{
+		int err = errno;
+		close(listenfd);
+		throw err;
+	}
+}
+
+control_socket::~control_socket()
+{
+	detach();
+
+	close(listenfd);
+	unlink(path.c_str());
+}
+
+bool control_socket::attach(fd_watcher* watcher)
+{
+	detach();
+
+	if (!watcher->watch(listenfd, EPOLLIN, this))
+		return false;
+
+	this->watcher = watcher;
+
+	return true;
+}
+
+/* Clients are dropped: they were only ever in the old watcher's set */
+void control_socket::detach()
+{
+	if (!watcher)
+		return;
+
+	for (auto& cl: clients)
+	{
+		watcher->unwatch(cl.fd);
+		close(cl.fd);
+	}
+	clients.clear();
+
+	watcher->unwatch(listenfd);
+	watcher = nullptr;
+}
+
+void control_socket::fd_event(int fd, uint32_t)
+{
+	if (fd == listenfd)
+	{
+		while ((fd = accept4(listenfd, nullptr, nullptr, SOCK_NONBLOCK)) != -1)
+		{
+			if (!watcher->watch(fd, EPOLLIN, this))
+			{
+				close(fd);
+				continue;
+			}
+			clients.push_back(client { fd, string() });
+		}
+
+		return;
+	}
+
+	for (auto it = clients.begin(); it != clients.end(); ++it)
+	{
+		if (it->fd != fd)
+			continue;
+
+		if (!service_client(*it))
+		{
+			watcher->unwatch(fd);
+			close(fd);
+			clients.erase(it);
+		}
+
+		return;
+	}
+}
+
+bool control_socket::service_client(client& cl)
+{
+	/* One read per event; if there's more, we'll hear about it again */
+	char buffer[512];
+	ssize_t n = read(cl.fd, buffer, sizeof(buffer));
+	if (n > 0)
+		cl.in.append(buffer, n);
+
+	/* Answer what was sent before the client hung up, too */
+	bool closed = n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK);
+
+	size_t nl;
+	while ((nl = cl.in.find('\n')) != string::npos)
+	{
+		string cmd = cl.in.substr(0, nl);
+		cl.in.erase(0, nl + 1);
+
+		if (!cmd.empty() && cmd.back() == '\r')
+			cmd.pop_back();
+
+		string reply = (handler ? handler(cmd) : string("error: not ready")) + '\n';
+
+		/* Replies are short; a client that doesn't read them gets dropped */
+		if (send(cl.fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) reply.size())
+			return false;
+	}
+
+	/* No command is that long, so this one never ends */
+	if (cl.in.size() > max_line)
+	{
+		const char reply[] = "error: line too long\n";
+		send(cl.fd, reply, sizeof(reply) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+		return false;
+	}
+
+	return !closed;
+}
@@ -0,0 +1,45 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <list>
+#include <string>
+#include <functional>
+
+#include "conn_poller.h"
+
+/* A local (Unix domain) socket that takes one command per line, and answers
+ * each with the handler's reply. Everything is non-blocking; once attached,
+ * its fds wait in the watcher's (the pool's) epoll set. */
+class control_socket : private fd_handler
+{
+public:
+	control_socket(const std::string& path);
+	~control_socket();
+
+	void set_handler(std::function<std::string(const std::string& cmd)> handler) { this->handler = handler; }
+	std::function<std::string(const std::string& cmd)> get_handler() { return handler; }
+
+	bool attach(fd_watcher* watcher);
+	void detach();
+
+private:
+	/* Longest command we'll wait for the end of */
+	static const size_t max_line = 4096;
+
+	struct client
+	{
+		int fd;
+		std::string in;
+	};
+
+	void fd_event(int fd, uint32_t events) override;
+	bool service_client(client& cl);
+
+	int listenfd;
+	std::string path;
+	std::list<client> clients;
+	std::function<std::string(const std::string& cmd)> handler;
+	fd_watcher* watcher = nullptr;
+};
+
+#endif /* CONTROL_H */
@@ -0,0 +1,97 @@
+#include <new>
+
+#include "coro.h"
+
+using namespace std;
+
+thread_local coro_arena* coro_arena::current = nullptr;
+
+/* Every frame starts with a header saying which arena (if any) it came from,
+ * since it may well be freed outside of the scope it was created in */
+static const size_t frame_header = alignof(max_align_t);
+
+void* coro_arena::allocate(size_t n)
+{
+	if (n > max_size)
+	{
+		in_use += n;
+		return ::operator new(n);
+	}
+
+	size_t cls = (n - 1) / granularity;
+	size_t size = (cls + 1) * granularity;
+	in_use += size;
+
+	if (free_lists[cls])
+	{
+		free_block* b = free_lists[cls];
+		free_lists[cls] = b->next;
+		return b;
+	}
+
+	if ((size_t) (bump_end - bump) < size)
+	{
+		chunks.emplace_back(new char[chunk_size]);
+		bump = chunks.back().get();
+		bump_end = bump + chunk_size;
+	}
+
+	void* p = bump;
+	bump += size;
+
+	return p;
+}
+
+void coro_arena::deallocate(void* p, size_t n)
+{
+	if (n > max_size)
+	{
+		in_use -= n;
+		::operator delete(p);
+		return;
+	}
+
+	size_t cls = (n - 1) / granularity;
+	in_use -= (cls + 1) * granularity;
+
+	free_block* b = (free_block*) p;
+	b->next = free_lists[cls];
+	free_lists[cls] = b;
+}
+
+void* coro_arena::allocate_frame(size_t n)
+{
+	coro_arena* arena = current;
+	char* p = (char*) (arena ? arena->allocate(n + frame_header) : ::operator new(n + frame_header));
+
+	*(coro_arena**) p = arena;
+
+	return p + frame_header;
+}
+
+void coro_arena::deallocate_frame(void* frame, size_t n)
+{
+	char* p = (char*) frame - frame_header;
+	coro_arena* arena = *(coro_arena**) p;
+
+	if (arena)
+		arena->deallocate(p, n + frame_header);
+	else
+		::operator delete(p);
+}
+
+coro_negotiator::task& coro_negotiator::task::operator=(task&& other)
+{
+	if (h)
+		h.destroy();
+	h = other.h;
+	other.h = nullptr;
+
+	return *this;
+}
+
+void coro_negotiator::start(task t)
+{
+	probe = std::move(t);
+	probe.h.resume();
+}
@@ -0,0 +1,224 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <coroutine>
+#include <exception>
+#include <algorithm>
+
+#include "negotiator.h"
+
+/* Recycles coroutine frames. Frames are rounded up to a size class, and freed
+ * ones go on that class' free list, so after warming up a pool allocates no
+ * more memory for new connections. */
+class coro_arena
+{
+public:
+	coro_arena() = default;
+	coro_arena(const coro_arena&) = delete;
+	coro_arena& operator=(const coro_arena&) = delete;
+
+	void* allocate(size_t n);
+	void deallocate(void* p, size_t n);
+
+	/* Bytes held by live frames. Chunks are kept for reuse once their frames
+	 * are freed, so this is what goes down again when connections close. */
+	size_t get_in_use() { return in_use; }
+
+	/* Frames created while a scope is alive come from its arena */
+	class scope
+	{
+	public:
+		scope(coro_arena& arena) : prev(current) { current = &arena; }
+		~scope() { current = prev; }
+
+	private:
+		coro_arena* prev;
+	};
+
+	static void* allocate_frame(size_t n);
+	static void deallocate_frame(void* p, size_t n);
+
+private:
+	static const size_t granularity = 64;
+	static const size_t max_size = 4096;
+	static const size_t chunk_size = 64 * 1024;
+
+	struct free_block
+	{
+		free_block* next;
+	};
+
+	free_block* free_lists[max_size / granularity] = { };
+	std::vector<std::unique_ptr<char[]>> chunks;
+	char* bump = nullptr;
+	char* bump_end = nullptr;
+	size_t in_use = 0;
+
+	static thread_local coro_arena* current;
+};
+
+/* A negotiator written as a coroutine: implement run(), and in it co_await
+ * read_byte() or read_until() for input, and call write() and emit() for
+ * the reply and the banner. */
+class coro_negotiator : public negotiator
+{
+public:
+	struct task
+	{
+		struct promise_type
+		{
+			task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return { }; }
+			std::suspend_always final_suspend() noexcept { return { }; }
+			void return_void() { }
+			void unhandled_exception() { std::terminate(); }
+
+			static void* operator new(size_t n) { return coro_arena::allocate_frame(n); }
+			static void operator delete(void* p, size_t n) { coro_arena::deallocate_frame(p, n); }
+		};
+
+		task() = default;
+		explicit task(std::coroutine_handle<promise_type> h) : h(h) { }
+		task(task&& other) : h(other.h) { other.h = nullptr; }
+		task& operator=(task&& other);
+		~task() { if (h) h.destroy(); }
+
+		std::coroutine_handle<promise_type> h = nullptr;
+	};
+
+	coro_negotiator() = default;
+	coro_negotiator(const coro_negotiator&) = delete;
+	coro_negotiator& operator=(const coro_negotiator&) = delete;
+
+	std::string crunch(unsigned char* buffer, size_t n) override;
+
+	bool has_write_data() override { return !out.empty(); }
+	std::vector<unsigned char> pop_write_queue() override;
+
+	bool finished() override { return !probe.h || probe.h.done(); }
+	size_t buffered() override { return in.capacity() + out.capacity() + banner.capacity(); }
+
+protected:
+	/* Suspends until there's input that satisfies it. The view returned by
+	 * read_until() is only valid until the next co_await. */
+	struct read_awaiter
+	{
+		coro_negotiator* n;
+		std::string_view delim;
+		size_t max;
+
+		bool await_ready() { return n->readable(*this); }
+		void await_suspend(std::coroutine_handle<> h) { n->waiting = this; n->resume_point = h; }
+		std::string_view await_resume() { return n->take(*this); }
+	};
+
+	struct byte_awaiter
+	{
+		read_awaiter r;
+
+		bool await_ready() { return r.await_ready(); }
+		void await_suspend(std::coroutine_handle<> h) { r.await_suspend(h); }
+		unsigned char await_resume() { return r.await_resume()[0]; }
+	};
+
+	void start(task t);
+
+	byte_awaiter read_byte() { return byte_awaiter { read_awaiter { this, std::string_view(), 1 } }; }
+	read_awaiter read_until(std::string_view delim, size_t max = 4096) { return read_awaiter { this, delim, max }; }
+
+	void write(std::initializer_list<unsigned char> data) { out.insert(out.end(), data); }
+	void write(std::string_view data) { out.insert(out.end(), data.begin(), data.end()); }
+	void emit(char ch) { banner += ch; }
+	void emit(std::string_view s) { banner += s; }
+
+private:
+	bool readable(const read_awaiter& r);
+	std::string_view take(const read_awaiter& r);
+
+	task probe;
+	std::coroutine_handle<> resume_point = nullptr;
+	read_awaiter* waiting = nullptr;
+
+	/* Input not consumed yet starts at in_pos */
+	std::string in;
+	size_t in_pos = 0;
+
+	std::vector<unsigned char> out;
+	std::string banner;
+};
+
+/* These run on every read, so they're here to be inlined into conn_pool */
+inline std::string coro_negotiator::crunch(unsigned char* buffer, size_t n)
+{
+	if (finished())
+		return std::string();
+
+	in.append((char*) buffer, n);
+
+	/* Keep resuming for as long as what it's waiting for is there */
+	while (waiting && readable(*waiting))
+	{
+		auto h = resume_point;
+		waiting = nullptr;
+		resume_point = nullptr;
+		h.resume();
+	}
+
+	if (in_pos == in.size())
+	{
+		in.clear();
+		in_pos = 0;
+	}
+
+	std::string s;
+	s.swap(banner);
+
+	return s;
+}
+
+inline bool coro_negotiator::readable(const read_awaiter& r)
+{
+	size_t avail = in.size() - in_pos;
+
+	if (r.delim.empty())
+		return avail >= r.max;
+
+	return avail >= r.max || std::string_view(in).find(r.delim, in_pos) != std::string_view::npos;
+}
+
+inline std::string_view coro_negotiator::take(const read_awaiter& r)
+{
+	/* Whatever was handed out last time is gone now */
+	if (in_pos > in.size() / 2)
+	{
+		in.erase(0, in_pos);
+		in_pos = 0;
+	}
+
+	size_t len = r.max;
+	if (!r.delim.empty())
+	{
+		size_t end = std::string_view(in).find(r.delim, in_pos);
+		if (end != std::string_view::npos)
+			len = std::min(len, end + r.delim.size() - in_pos);
+	}
+
+	std::string_view s = std::string_view(in).substr(in_pos, len);
+	in_pos += s.size();
+
+	return s;
+}
+
+inline std::vector<unsigned char> coro_negotiator::pop_write_queue()
+{
+	std::vector<unsigned char> v;
+	v.swap(out);
+
+	return v;
+}
+
+#endif /* CORO_H */
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "dedup.h"
+#include "atomic_write.h"
+
+using namespace std;
+
+static const char magic[8] = { 'C', 'O', 'N', 'N', 'D', 'U', 'P', '1' };
+
+addr_bitmap::addr_bitmap(mode m)
+	: m(m)
+{
+	if (m == mode::flat)
+	{
+		void* p = mmap(nullptr, (1ul << 32) / 8, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			throw errno;
+
+		flat = (uint64_t*) p;
+	}
+	else
+	{
+		pages.resize(65536);
+	}
+}
+
+addr_bitmap::~addr_bitmap()
+{
+	if (flat)
+		munmap(flat, (1ul << 32) / 8);
+}
+
+uint64_t* addr_bitmap::page(uint32_t index, bool create)
+{
+	if (flat)
+		return flat + index * page_words;
+
+	auto& p = pages[index];
+	if (!p && create)
+	{
+		p.reset(new uint64_t[page_words]());
+		n_pages++;
+	}
+
+	return p.get();
+}
+
+bool addr_bitmap::test_and_set(uint32_t addr)
+{
+	uint64_t* p = page(addr >> 16, true);
+	uint64_t& word = p[(addr & 0xffff) >> 6];
+	uint64_t bit = 1ull << (addr & 63);
+
+	bool was_set = word & bit;
+	word |= bit;
+
+	return was_set;
+}
+
+bool addr_bitmap::test_and_set(const string& host)
+{
+	struct in_addr addr;
+	if (inet_pton(AF_INET, host.c_str(), &addr) != 1)
+		return false;
+
+	return test_and_set(ntohl(addr.s_addr));
+}
+
+size_t addr_bitmap::get_memory_usage()
+{
+	if (flat)
+		return (1ul << 32) / 8;
+
+	return n_pages * page_words * sizeof(uint64_t) + pages.size() * sizeof(pages[0]);
+}
+
+/* File layout: magic, port, page count, and then every non-empty page,
+ * prefixed with its index. Everything is in host byte order. */
+
+bool addr_bitmap::load(const string& filename, int port)
+{
+	ifstream in(filename, ifstream::binary);
+	if (in.fail())
+		return false;
+
+	char file_magic[sizeof(magic)];
+	uint32_t file_port, count;
+	in.read(file_magic, sizeof(file_magic));
+	in.read((char*) &file_port, sizeof(file_port));
+	in.read((char*) &count, sizeof(count));
+
+	if (!in || memcmp(file_magic, magic, sizeof(magic)) || file_port != (uint32_t) port)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t index;
+		in.read((char*) &index, sizeof(index));
+		if (!in || index >= 65536)
+		{
+			errno = EINVAL;
+			return false;
+		}
+
+		uint64_t* p = page(index, true);
+		in.read((char*) p, page_words * sizeof(uint64_t));
+	}
+
+	if (!in)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	return true;
+}
+
+bool addr_bitmap::save(const string& filename, int port)
+{
+	vector<uint32_t> used;
+	for (uint32_t index = 0; index < 65536; index++)
+	{
+		uint64_t* p = page(index, false);
+		if (!p)
+			continue;
+
+		for (size_t i = 0; i < page_words; i++)
+		{
+			if (p[i])
+			{
+				used.push_back(index);
+				break;
+			}
+		}
+	}
+
+	return atomic_write(filename, [&](ostream& out) {
+		uint32_t file_port = port;
+		uint32_t count = used.size();
+		out.write(magic, sizeof(magic));
+		out.write((char*) &file_port, sizeof(file_port));
+		out.write((char*) &count, sizeof(count));
+
+		for (uint32_t index: used)
+		{
+			out.write((char*) &index, sizeof(index));
+			out.write((char*) page(index, false), page_words * sizeof(uint64_t));
+		}
+	});
+}
@@ -0,0 +1,43 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/* One bit for every IPv4 address. 'flat' reserves the full 512 MB up front and
+ * lets the kernel back it as it gets touched; 'sparse' allocates 8 KB pages
+ * (one per /16) on first use, which is smaller for scans of a few ranges. */
+class addr_bitmap
+{
+public:
+	enum class mode
+	{
+		flat,
+		sparse,
+	};
+
+	addr_bitmap(mode m);
+	~addr_bitmap();
+
+	bool test_and_set(uint32_t addr);
+	bool test_and_set(const std::string& host);
+
+	bool load(const std::string& filename, int port);
+	bool save(const std::string& filename, int port);
+
+	size_t get_memory_usage();
+
+private:
+	static const size_t page_words = 65536 / 64;
+
+	uint64_t* page(uint32_t index, bool create);
+
+	mode m;
+	uint64_t* flat = nullptr;
+	std::vector<std::unique_ptr<uint64_t[]>> pages;
+	size_t n_pages = 0;
+};
+
+#endif /* DEDUP_H */
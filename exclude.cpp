@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <fstream>
+#include <algorithm>
+#include <arpa/inet.h>
+
+#include "exclude.h"
+
+using namespace std;
+
+bool cidr_set::load(const string& filename)
+{
+	ifstream in(filename);
+	if (in.fail())
+		return false;
+
+	starts.clear();
+	ends.clear();
+	index.clear();
+
+	string s;
+	while (getline(in, s))
+	{
+		/* Strip comments and whitespace */
+		s = s.substr(0, s.find('#'));
+		s.erase(remove_if(s.begin(), s.end(), ::isspace), s.end());
+		if (s.empty())
+			continue;
+
+		int bits = 32;
+		size_t slash = s.find('/');
+		if (slash != string::npos)
+		{
+			char* end;
+			bits = strtol(s.c_str() + slash + 1, &end, 10);
+			if (*end || bits < 0 || bits > 32)
+			{
+				errno = EINVAL;
+				return false;
+			}
+			s.erase(slash);
+		}
+
+		struct in_addr addr;
+		if (inet_pton(AF_INET, s.c_str(), &addr) != 1)
+		{
+			errno = EINVAL;
+			return false;
+		}
+
+		uint32_t mask = bits ? ~0u << (32 - bits) : 0;
+		uint32_t first = ntohl(addr.s_addr) & mask;
+		add(first, first | ~mask);
+	}
+
+	compile();
+
+	return true;
+}
+
+void cidr_set::add(uint32_t first, uint32_t last)
+{
+	starts.push_back(first);
+	ends.push_back(last);
+}
+
+void cidr_set::compile()
+{
+	vector<pair<uint32_t, uint32_t>> ranges;
+	ranges.reserve(starts.size());
+	for (size_t i = 0; i < starts.size(); i++)
+		ranges.emplace_back(starts[i], ends[i]);
+
+	sort(ranges.begin(), ranges.end());
+
+	starts.clear();
+	ends.clear();
+
+	/* Merge overlapping and adjacent ranges */
+	for (auto& r: ranges)
+	{
+		if (!ends.empty() && (uint64_t) r.first <= (uint64_t) ends.back() + 1)
+		{
+			ends.back() = max(ends.back(), r.second);
+			continue;
+		}
+
+		starts.push_back(r.first);
+		ends.push_back(r.second);
+	}
+
+	starts.shrink_to_fit();
+	ends.shrink_to_fit();
+
+	index.clear();
+	if (starts.empty())
+		return;
+
+	index.resize(65537);
+	size_t i = 0;
+	for (uint32_t p = 0; p < 65536; p++)
+	{
+		while (i + 1 < starts.size() && starts[i + 1] <= p << 16)
+			i++;
+		index[p] = i;
+	}
+	index[65536] = starts.size() - 1;
+}
+
+bool cidr_set::contains(uint32_t addr) const
+{
+	if (starts.empty())
+		return false;
+
+	/* Find the last interval starting at or before addr. The halving step
+	 * compiles to a conditional move, so there are no mispredicted branches. */
+	uint32_t p = addr >> 16;
+	const uint32_t* base = starts.data() + index[p];
+	size_t n = index[p + 1] - index[p] + 1;
+	while (n > 1)
+	{
+		size_t half = n / 2;
+		base = base[half] <= addr ? base + half : base;
+		n -= half;
+	}
+
+	return *base <= addr && addr <= ends[base - starts.data()];
+}
+
+bool cidr_set::contains(const string& host) const
+{
+	struct in_addr addr;
+	if (inet_pton(AF_INET, host.c_str(), &addr) != 1)
+		return false;
+
+	return contains(ntohl(addr.s_addr));
+}
@@ -0,0 +1,32 @@
+#ifndef EXCLUDE_H
+#define EXCLUDE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* A set of IPv4 ranges, compiled into sorted, non-overlapping intervals */
+class cidr_set
+{
+public:
+	bool load(const std::string& filename);
+
+	void add(uint32_t first, uint32_t last);
+	void compile();
+
+	bool contains(uint32_t addr) const;
+	bool contains(const std::string& host) const;
+
+	size_t size() const { return starts.size(); }
+
+private:
+	/* Kept apart, so the search only touches the starts */
+	std::vector<uint32_t> starts;
+	std::vector<uint32_t> ends;
+
+	/* For every /16, the last interval starting at or before it. This narrows
+	 * the search down to a few, neighbouring entries. */
+	std::vector<uint32_t> index;
+};
+
+#endif /* EXCLUDE_H */
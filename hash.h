@@ -0,0 +1,22 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <string_view>
+#include <cstdint>
+
+static const uint64_t fnv1a_basis = 0xcbf29ce484222325;
+static const uint64_t fnv1a_prime = 0x100000001b3;
+
+/* 64-bit FNV-1a, continuing from h */
+inline uint64_t fnv1a(std::string_view s, uint64_t h = fnv1a_basis)
+{
+	for (unsigned char ch: s)
+	{
+		h ^= ch;
+		h *= fnv1a_prime;
+	}
+
+	return h;
+}
+
+#endif /* HASH_H */
@@ -1,16 +1,52 @@
 #include <unistd.h>
+#include <getopt.h>
 #include <iostream>
 #include <signal.h>
+#include <stdio.h>
 #include <string.h>
 #include <memory>
+#include <algorithm>
 
-#include "telnet.h"
 #include "connector.h"
 
 using namespace std;
 
 static shared_ptr<connector> c;
 
+/* Options that only have a long form */
+enum
+{
+	opt_shard = 0x100,
+	opt_control,
+	opt_checkpoint,
+	opt_resume,
+	opt_exclude,
+	opt_dedup,
+	opt_dedup_file,
+	opt_signatures,
+	opt_mem_limit,
+	opt_max_banner,
+	opt_record,
+	opt_incremental,
+};
+
+static const struct option long_options[] =
+{
+	{ "shard", required_argument, nullptr, opt_shard },
+	{ "control", required_argument, nullptr, opt_control },
+	{ "checkpoint", required_argument, nullptr, opt_checkpoint },
+	{ "resume", required_argument, nullptr, opt_resume },
+	{ "exclude", required_argument, nullptr, opt_exclude },
+	{ "dedup", required_argument, nullptr, opt_dedup },
+	{ "dedup-file", required_argument, nullptr, opt_dedup_file },
+	{ "signatures", required_argument, nullptr, opt_signatures },
+	{ "mem-limit", required_argument, nullptr, opt_mem_limit },
+	{ "max-banner", required_argument, nullptr, opt_max_banner },
+	{ "record", required_argument, nullptr, opt_record },
+	{ "incremental", required_argument, nullptr, opt_incremental },
+	{ nullptr, 0, nullptr, 0 },
+};
+
 static void sigint_handler(int)
 {
 	c->die();
@@ -30,15 +66,93 @@ static void sigcont_handler(int)
 	c->cont();
 }
 
-static shared_ptr<negotiator_provider> get_negot(char* s)
+static void sighup_handler(int)
 {
-	if (strcmp(s, "telnet") == 0)
-		return make_shared<telnet_provider>();
-	else
+	c->request_reload();
+}
+
+static shared_ptr<negotiator_provider> get_negot(const char* s)
+{
+	auto prov = make_negotiator_provider(s);
+	if (!prov)
 	{
-		cerr << "The only valid negotiator for now is \"telnet\"\n";
+		cerr << "Valid negotiators are " << negotiator_names << '\n';
 		exit(1);
 	}
+
+	return prov;
+}
+
+/* A byte count, optionally followed by K, M or G */
+static bool parse_size(const char* s, size_t& size)
+{
+	char* end;
+	size = strtoull(s, &end, 10);
+	if (end == s)
+		return false;
+
+	switch (toupper(*end))
+	{
+		case 'G': size <<= 10; /* fall through */
+		case 'M': size <<= 10; /* fall through */
+		case 'K': size <<= 10; end++; break;
+		case '\0': break;
+		default: return false;
+	}
+
+	return *end == '\0';
+}
+
+/* A checkpoint only makes sense for the port and shard that wrote it: the
+ * line numbers would be the same, but not what's behind them */
+static bool read_checkpoint(const char* filename, int port, int shard, int shards, int& skip)
+{
+	ifstream in(filename);
+	if (in.fail())
+	{
+		cerr << "Could not read " << filename << ": " << strerror(errno) << '\n';
+		return false;
+	}
+
+	/* Unsharded scans don't write a shard= line */
+	int file_port = -1;
+	int file_shard = 0;
+	int file_shards = 1;
+	bool has_skip = false;
+
+	string s;
+	while (getline(in, s))
+	{
+		if (s.compare(0, 5, "port=") == 0)
+			file_port = atoi(s.c_str() + 5);
+		else if (s.compare(0, 6, "shard=") == 0)
+			sscanf(s.c_str() + 6, "%d/%d", &file_shard, &file_shards);
+		else if (s.compare(0, 5, "skip=") == 0)
+		{
+			skip = atoi(s.c_str() + 5);
+			has_skip = true;
+		}
+	}
+
+	if (!has_skip)
+	{
+		cerr << filename << " is not a checkpoint file\n";
+		return false;
+	}
+
+	if (file_port != port)
+	{
+		cerr << filename << " is for a different port\n";
+		return false;
+	}
+
+	if (file_shard != shard || file_shards != shards)
+	{
+		cerr << filename << " is for shard " << file_shard << '/' << file_shards << '\n';
+		return false;
+	}
+
+	return true;
 }
 
 int main(int argc, char** argv)
@@ -46,6 +160,8 @@ int main(int argc, char** argv)
 	int port = -1;
 	size_t maxcon = 10;
 	int ttl = 60;
+	int connect_timeout = 0;
+	int idle_timeout = 0;
 	int conn_rate = 1;
 	char* in_filename = nullptr;
 	char* out_filename = nullptr;
@@ -53,9 +169,27 @@ int main(int argc, char** argv)
 	int skip = 0;
 	bool to_terminal = false;
 	std::shared_ptr<negotiator_provider> prov = nullptr;
+	bool syn_prescan = false;
+	int syn_wait = 1000;
+	int max_retries = 0;
+	int backoff_ms = 1000;
+	int shard = 0;
+	int shards = 1;
+	char* control_path = nullptr;
+	char* checkpoint_filename = nullptr;
+	char* resume_filename = nullptr;
+	char* exclude_filename = nullptr;
+	char* dedup_filename = nullptr;
+	char* signatures_filename = nullptr;
+	char* record_filename = nullptr;
+	char* index_filename = nullptr;
+	size_t mem_limit = 0;
+	size_t max_banner = 0;
+	bool dedup = false;
+	addr_bitmap::mode dedup_mode = addr_bitmap::mode::sparse;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "s:p:m:l:r:i:o:n:aht")) != -1)
+	while ((opt = getopt_long(argc, argv, "s:p:m:l:c:d:r:i:o:n:W:R:B:ahtS", long_options, nullptr)) != -1)
        	{
 		switch (opt)
 	       	{
@@ -77,6 +211,12 @@ int main(int argc, char** argv)
 			case 'l':
 				ttl = atoi(optarg);
 				break;
+			case 'c':
+				connect_timeout = atoi(optarg);
+				break;
+			case 'd':
+				idle_timeout = atoi(optarg);
+				break;
 			case 'r':
 				conn_rate = atoi(optarg);
 				break;
@@ -89,6 +229,72 @@ int main(int argc, char** argv)
 			case 'n':
 				prov = get_negot(optarg);
 				break;
+			case 'S':
+				syn_prescan = true;
+				break;
+			case 'W':
+				syn_wait = atoi(optarg);
+				break;
+			case 'R':
+				max_retries = atoi(optarg);
+				break;
+			case 'B':
+				backoff_ms = atoi(optarg);
+				break;
+
+			case opt_shard:
+				if (sscanf(optarg, "%d/%d", &shard, &shards) != 2 || shards < 1 || shard < 0 || shard >= shards)
+				{
+					cerr << "Invalid shard \"" << optarg << "\", expected i/N with 0 <= i < N\n";
+					return 1;
+				}
+				break;
+
+			case opt_control:
+				control_path = optarg;
+				break;
+			case opt_checkpoint:
+				checkpoint_filename = optarg;
+				break;
+			case opt_exclude:
+				exclude_filename = optarg;
+				break;
+			case opt_dedup:
+				dedup = true;
+				if (strcmp(optarg, "flat") == 0)
+					dedup_mode = addr_bitmap::mode::flat;
+				else if (strcmp(optarg, "sparse") == 0)
+					dedup_mode = addr_bitmap::mode::sparse;
+				else
+				{
+					cerr << "--dedup must be \"flat\" or \"sparse\"\n";
+					return 1;
+				}
+				break;
+			case opt_dedup_file:
+				dedup = true;
+				dedup_filename = optarg;
+				break;
+			case opt_signatures:
+				signatures_filename = optarg;
+				break;
+			case opt_record:
+				record_filename = optarg;
+				break;
+			case opt_incremental:
+				index_filename = optarg;
+				break;
+			case opt_mem_limit:
+			case opt_max_banner:
+				if (!parse_size(optarg, opt == opt_mem_limit ? mem_limit : max_banner))
+				{
+					cerr << "Invalid size \"" << optarg << "\"\n";
+					return 1;
+				}
+				break;
+			case opt_resume:
+				resume_filename = optarg;
+				break;
 
 			case 'h':
 			default:
@@ -101,8 +307,26 @@ int main(int argc, char** argv)
 				cerr << "\t-a: Append, don't truncate\n";
 				cerr << "\t-m: Maximum concurrent connections\n";
 				cerr << "\t-l: Time to live (seconds)\n";
+				cerr << "\t-c: Connect timeout, 0 to only use -l (seconds)\n";
+				cerr << "\t-d: Close connections that have been idle since the last data received, 0 to disable (seconds)\n";
 				cerr << "\t-r: Max connection rate (sockets/second)\n";
 				cerr << "\t-n: Use a negotiator. Use -n help for a list\n";
+				cerr << "\t-S: Only connect to hosts that answer a SYN pre-scan (needs CAP_NET_RAW)\n";
+				cerr << "\t-W: Time to wait for SYN-ACKs in the pre-scan (milliseconds)\n";
+				cerr << "\t-R: Retry timed out or unreachable connections up to n times\n";
+				cerr << "\t-B: Initial retry backoff, doubled on every attempt (milliseconds)\n";
+				cerr << "\t--shard i/N: Only scan the targets owned by node i (counting from 0) out of N\n";
+				cerr << "\t--control path: Listen for commands (stats, set, pause, resume, checkpoint) on a Unix socket\n";
+				cerr << "\t--checkpoint file: Where to save the resume position (on exit, or on the checkpoint command)\n";
+				cerr << "\t--resume file: Skip to the position saved in a checkpoint file\n";
+				cerr << "\t--exclude file: Never connect to addresses in these CIDR ranges (reloaded on SIGHUP)\n";
+				cerr << "\t--dedup flat|sparse: Skip addresses seen before, using a full 512 MB bitmap or one allocated per /16\n";
+				cerr << "\t--dedup-file file: Load the addresses seen before from this file, and save them back when done\n";
+				cerr << "\t--mem-limit size: Stop reading new targets when connections hold close to this much memory (K/M/G)\n";
+				cerr << "\t--max-banner size: Close connections once they've sent this much (K/M/G, defaults to the limit divided by -m)\n";
+				cerr << "\t--signatures file: Label banners with the first matching signature (label<TAB>string[<TAB>i] per line)\n";
+				cerr << "\t--incremental file: Only write banners that are new (+) or changed (~) since the scan that saved this index, and hosts that are gone (-); then update it\n";
+				cerr << "\t--record file: Save a trace of every connection's events, for connector-replay\n";
 				return 1;
 		}
 	}
@@ -113,6 +337,15 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (resume_filename && !read_checkpoint(resume_filename, port, shard, shards, skip))
+		return 1;
+
+	if (maxcon < 1)
+	{
+		cerr << "-m needs to allow at least one connection\n";
+		return 1;
+	}
+
 	if (out_filename && to_terminal)
 	{
 		cerr << "Cannot use -t in combination with -o\n";
@@ -160,10 +393,119 @@ int main(int argc, char** argv)
 	c->set_skip(skip);
 	c->set_maxcon(maxcon);
 	c->set_ttl(ttl);
+	c->set_connect_timeout(connect_timeout);
+	c->set_idle_timeout(idle_timeout);
 	c->set_conn_rate(conn_rate);
+	c->set_max_retries(max_retries);
+	c->set_backoff_ms(backoff_ms);
+	c->set_shard(shard, shards);
+
+	/* Without a cap, a few chatty hosts could blow through the limit on their own */
+	if (mem_limit && !max_banner)
+		max_banner = max(mem_limit / maxcon, (size_t) 4096);
+
+	c->set_mem_limit(mem_limit);
+	c->set_max_banner(max_banner);
+
+	if (checkpoint_filename)
+		c->set_checkpoint_file(checkpoint_filename);
+
+	if (exclude_filename && !c->set_exclude_file(exclude_filename))
+	{
+		cerr << "Could not load " << exclude_filename << ": " << strerror(errno) << '\n';
+		return 1;
+	}
+
+	if (signatures_filename)
+	{
+		auto classifier = make_shared<banner_classifier>();
+		if (!classifier->load(signatures_filename))
+		{
+			cerr << "Could not load " << signatures_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		c->set_classifier(classifier);
+	}
+
+	if (dedup)
+	{
+		try
+		{
+			auto bitmap = make_shared<addr_bitmap>(dedup_mode);
+			if (dedup_filename)
+			{
+				if (!bitmap->load(dedup_filename, port) && errno != ENOENT)
+				{
+					cerr << "Could not load " << dedup_filename << ": " << strerror(errno) << '\n';
+					return 1;
+				}
+				c->set_dedup_file(dedup_filename);
+			}
+			c->set_dedup(bitmap);
+		}
+		catch (int err)
+		{
+			cerr << "Could not allocate the dedup bitmap: " << strerror(err) << '\n';
+			return 1;
+		}
+	}
+
+	if (index_filename)
+	{
+		auto index = make_shared<banner_index>();
+		if (!index->load(index_filename, port) && errno != ENOENT)
+		{
+			cerr << "Could not load " << index_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		c->set_index(index);
+		c->set_index_file(index_filename);
+	}
+
+	if (control_path)
+	{
+		try
+		{
+			if (!c->set_control(make_shared<control_socket>(control_path)))
+				throw errno;
+		}
+		catch (int err)
+		{
+			cerr << "Could not listen on " << control_path << ": " << strerror(err) << '\n';
+			return 1;
+		}
+	}
+
+	std::shared_ptr<trace_writer> trace = nullptr;
+	if (record_filename)
+	{
+		trace = make_shared<trace_writer>();
+		if (!trace->open(record_filename))
+		{
+			cerr << "Could not open " << record_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		c->set_trace(trace);
+	}
+
 	c->set_prov(prov);
 	c->set_to_terminal(to_terminal);
 
+	if (syn_prescan)
+	{
+		try
+		{
+			auto prescan = make_shared<syn_scanner>(port);
+			prescan->set_wait_ms(syn_wait);
+			c->set_prescan(prescan);
+		}
+		catch (int err)
+		{
+			cerr << "Could not set up the SYN pre-scan: " << strerror(err) << '\n';
+			return 1;
+		}
+	}
+
 	/* Catch signals */
 	struct sigaction sa;
 	sa.sa_handler = sigint_handler;
@@ -178,9 +520,25 @@ int main(int argc, char** argv)
 
 	sigaction(SIGCONT, &sa, nullptr);
 
+	/* Without an exclude file there's nothing to reload, so a hangup still ends the scan */
+	if (exclude_filename)
+	{
+		sa.sa_handler = sighup_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART;
+
+		sigaction(SIGHUP, &sa, nullptr);
+	}
+
 	/* Finally, run. */
 	c->run();
 
+	if (trace && !trace->close())
+	{
+		cerr << "Could not write " << record_filename << ": " << strerror(errno) << '\n';
+		return 1;
+	}
+
 	return 0;
 }
 
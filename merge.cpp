@@ -0,0 +1,167 @@
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <arpa/inet.h>
+
+using namespace std;
+
+/* Combines the outputs of several (sharded) connector runs into one, ordered by address.
+ * With -c, the inputs are checkpoint files instead, and the merged checkpoint
+ * resumes from the earliest position any of them would. */
+
+struct result_line
+{
+	uint32_t addr;
+	string line;
+};
+
+static uint32_t parse_addr(const string& line)
+{
+	/* Incremental scans mark lines with "+ ", "~ " or "- " */
+	size_t start = 0;
+	if (line.size() >= 2 && (line[0] == '+' || line[0] == '~' || line[0] == '-') && line[1] == ' ')
+		start = 2;
+
+	string host = line.substr(start, line.find_first_of(": ", start) - start);
+
+	struct in_addr addr;
+	if (inet_pton(AF_INET, host.c_str(), &addr) != 1)
+		return 0;
+
+	return ntohl(addr.s_addr);
+}
+
+static bool read_results(const char* filename, vector<result_line>& results)
+{
+	ifstream in(filename);
+	if (in.fail())
+	{
+		cerr << "Could not open " << filename << ": " << strerror(errno) << '\n';
+		return false;
+	}
+
+	string s;
+	while (getline(in, s))
+		results.push_back(result_line { parse_addr(s), s });
+
+	return true;
+}
+
+static bool read_checkpoint(const char* filename, string& port, long& skip)
+{
+	ifstream in(filename);
+	if (in.fail())
+	{
+		cerr << "Could not open " << filename << ": " << strerror(errno) << '\n';
+		return false;
+	}
+
+	string s;
+	bool has_skip = false;
+	while (getline(in, s))
+	{
+		if (s.compare(0, 5, "port=") == 0)
+		{
+			if (!port.empty() && port != s)
+			{
+				cerr << filename << " is for a different port\n";
+				return false;
+			}
+			port = s;
+		}
+		else if (s.compare(0, 5, "skip=") == 0)
+		{
+			long file_skip = atol(s.c_str() + 5);
+			skip = skip < 0 ? file_skip : min(skip, file_skip);
+			has_skip = true;
+		}
+	}
+
+	if (!has_skip)
+		cerr << filename << " is not a checkpoint file\n";
+
+	return has_skip;
+}
+
+int main(int argc, char** argv)
+{
+	char* out_filename = nullptr;
+	bool checkpoints = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:ch")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				out_filename = optarg;
+				break;
+			case 'c':
+				checkpoints = true;
+				break;
+
+			case 'h':
+			default:
+				cerr << "Usage: " << argv[0] << " [options] file...\n";
+				cerr << "\t-o: Set output file to write the merged results to (instead of stdout)\n";
+				cerr << "\t-c: Merge checkpoint files instead of results\n";
+				return 1;
+		}
+	}
+
+	if (optind >= argc)
+	{
+		cerr << "No input files specified\n";
+		return 1;
+	}
+
+	vector<result_line> results;
+	string port;
+	long skip = -1;
+	for (int i = optind; i < argc; i++)
+	{
+		if (checkpoints ? !read_checkpoint(argv[i], port, skip) : !read_results(argv[i], results))
+			return 1;
+	}
+
+	sort(results.begin(), results.end(), [](const result_line& a, const result_line& b)
+			{ return a.addr != b.addr ? a.addr < b.addr : a.line < b.line; });
+
+	/* Re-running a node over the same shard shouldn't duplicate its results */
+	results.erase(unique(results.begin(), results.end(), [](const result_line& a, const result_line& b)
+			{ return a.line == b.line; }), results.end());
+
+	ostream* out_stream;
+	ofstream out_file;
+	if (out_filename)
+	{
+		out_file.open(out_filename, ofstream::out | ofstream::trunc);
+		if (out_file.fail())
+		{
+			cerr << "Could not open " << out_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		out_stream = &out_file;
+	}
+	else
+	{
+		out_stream = &cout;
+	}
+
+	if (checkpoints)
+	{
+		if (!port.empty())
+			*out_stream << port << '\n';
+		*out_stream << "skip=" << skip << '\n';
+	}
+
+	for (auto& r: results)
+		*out_stream << r.line << '\n';
+
+	return 0;
+}
@@ -0,0 +1,17 @@
+#include "negotiator.h"
+#include "telnet.h"
+#include "tls.h"
+
+using namespace std;
+
+const char* const negotiator_names = "\"telnet\" and \"tls\"";
+
+shared_ptr<negotiator_provider> make_negotiator_provider(const string& name, bool boxed)
+{
+	if (name == "telnet")
+		return make_shared<telnet_provider>(boxed);
+	else if (name == "tls")
+		return make_shared<tls_provider>(boxed);
+
+	return nullptr;
+}
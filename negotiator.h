@@ -13,14 +13,27 @@ public:
 
 	virtual bool has_write_data() = 0;
 	virtual std::vector<unsigned char> pop_write_queue() = 0;
+
+	/* Once true, the connection is closed and its banner reported */
+	virtual bool finished() { return false; }
+
+	/* Bytes held in buffers and queues, for memory accounting */
+	virtual size_t buffered() { return 0; }
 };
 
+class negotiator_slot;
+
 class negotiator_provider
 {
 public:
 	virtual ~negotiator_provider() { }
-	virtual std::shared_ptr<negotiator> provide(int sockfd) = 0;
+	virtual void provide(negotiator_slot& slot, int sockfd) = 0;
 };
 
+/* The built-in negotiators, by the name -n takes. Unknown names give nullptr.
+ * Boxed ones are called through the vtable, for comparison. */
+std::shared_ptr<negotiator_provider> make_negotiator_provider(const std::string& name, bool boxed = false);
+extern const char* const negotiator_names;
+
 #endif /* NEGOTIATOR_H */
 
@@ -0,0 +1,86 @@
+#ifndef NEGOTIATOR_SLOT_H
+#define NEGOTIATOR_SLOT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <variant>
+
+#include "negotiator.h"
+#include "telnet.h"
+#include "tls.h"
+
+template <class... Ts> struct slot_visitor : Ts... { using Ts::operator()...; };
+template <class... Ts> slot_visitor(Ts...) -> slot_visitor<Ts...>;
+
+/* Holds a connection's negotiator. The built-in ones live inline and are called
+ * without virtual dispatch; anything else is held through a shared_ptr. */
+class negotiator_slot
+{
+public:
+	template <class N, class... Args>
+	void emplace(Args&&... args) { v.template emplace<N>(std::forward<Args>(args)...); }
+
+	negotiator_slot& operator=(std::shared_ptr<negotiator> negot)
+	{
+		if (negot)
+			v = std::move(negot);
+		else
+			v = std::monostate();
+		return *this;
+	}
+
+	void reset() { v = std::monostate(); }
+
+	explicit operator bool() const { return !std::holds_alternative<std::monostate>(v); }
+
+	std::string crunch(unsigned char* buffer, size_t n)
+	{
+		return std::visit(slot_visitor {
+			[](std::monostate&) { return std::string(); },
+			[&](std::shared_ptr<negotiator>& negot) { return negot->crunch(buffer, n); },
+			[&](auto& negot) { return negot.crunch(buffer, n); },
+		}, v);
+	}
+
+	bool has_write_data()
+	{
+		return std::visit(slot_visitor {
+			[](std::monostate&) { return false; },
+			[](std::shared_ptr<negotiator>& negot) { return negot->has_write_data(); },
+			[](auto& negot) { return negot.has_write_data(); },
+		}, v);
+	}
+
+	std::vector<unsigned char> pop_write_queue()
+	{
+		return std::visit(slot_visitor {
+			[](std::monostate&) { return std::vector<unsigned char>(); },
+			[](std::shared_ptr<negotiator>& negot) { return negot->pop_write_queue(); },
+			[](auto& negot) { return negot.pop_write_queue(); },
+		}, v);
+	}
+
+	bool finished()
+	{
+		return std::visit(slot_visitor {
+			[](std::monostate&) { return false; },
+			[](std::shared_ptr<negotiator>& negot) { return negot->finished(); },
+			[](auto& negot) { return negot.finished(); },
+		}, v);
+	}
+
+	size_t buffered()
+	{
+		return std::visit(slot_visitor {
+			[](std::monostate&) { return (size_t) 0; },
+			[](std::shared_ptr<negotiator>& negot) { return negot->buffered(); },
+			[](auto& negot) { return negot.buffered(); },
+		}, v);
+	}
+
+private:
+	std::variant<std::monostate, telnet_negotiator, tls_negotiator, std::shared_ptr<negotiator>> v;
+};
+
+#endif /* NEGOTIATOR_SLOT_H */
@@ -0,0 +1,208 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+#include <memory>
+#include <arpa/inet.h>
+
+#include "conn_pool.h"
+#include "connector.h"
+
+using namespace std;
+
+/* Runs a trace saved with connector --record back through the connection pool,
+ * as fast as it'll go. The banners come out the way connector would have
+ * written them, so the output of two builds can be diffed. */
+
+enum
+{
+	opt_signatures = 0x100,
+	opt_max_banner,
+	opt_boxed,
+};
+
+static const struct option long_options[] =
+{
+	{ "signatures", required_argument, nullptr, opt_signatures },
+	{ "max-banner", required_argument, nullptr, opt_max_banner },
+	{ "boxed", no_argument, nullptr, opt_boxed },
+	{ nullptr, 0, nullptr, 0 },
+};
+
+static shared_ptr<negotiator_provider> get_negot(const char* s, bool boxed)
+{
+	auto prov = make_negotiator_provider(s, boxed);
+	if (!prov)
+	{
+		cerr << "Valid negotiators are " << negotiator_names << '\n';
+		exit(1);
+	}
+
+	return prov;
+}
+
+int main(int argc, char** argv)
+{
+	char* out_filename = nullptr;
+	char* signatures_filename = nullptr;
+	char* negot_name = nullptr;
+	bool boxed = false;
+	size_t max_banner = 0;
+	int repeat = 1;
+	bool quiet = false;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "o:n:r:qh", long_options, nullptr)) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				out_filename = optarg;
+				break;
+			case 'n':
+				negot_name = optarg;
+				break;
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			case opt_signatures:
+				signatures_filename = optarg;
+				break;
+			case opt_max_banner:
+				max_banner = strtoull(optarg, nullptr, 10);
+				break;
+			case opt_boxed:
+				boxed = true;
+				break;
+			case 'h':
+			default:
+				cerr << "Usage: " << argv[0] << " [options] trace\n";
+				cerr << "\t-o: Write banners to this file (instead of stdout)\n";
+				cerr << "\t-n: Use a negotiator (telnet or tls), as the recording did\n";
+				cerr << "\t-r: Play the trace this many times over\n";
+				cerr << "\t-q: Don't write the banners, only time it\n";
+				cerr << "\t--max-banner bytes: Cut banners off at this size\n";
+				cerr << "\t--signatures file: Label banners with the first matching signature\n";
+				cerr << "\t--boxed: Call the negotiator through its vtable, to compare against\n";
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		cerr << "Expected one trace file, see -h\n";
+		return 1;
+	}
+
+	shared_ptr<negotiator_provider> prov = nullptr;
+	if (negot_name)
+		prov = get_negot(negot_name, boxed);
+
+	trace_reader reader;
+	if (!reader.open(argv[optind]))
+	{
+		cerr << "Could not open " << argv[optind] << ": " << strerror(errno) << '\n';
+		return 1;
+	}
+
+	ofstream out_file;
+	ostream* out = &cout;
+	if (out_filename)
+	{
+		out_file.open(out_filename);
+		if (out_file.fail())
+		{
+			cerr << "Could not open " << out_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		out = &out_file;
+	}
+
+	basic_conn_pool<replay_backend> pool;
+	replay_backend& backend = pool.get_backend();
+
+	pool.set_prov(prov);
+	pool.set_max_banner(max_banner);
+
+	if (signatures_filename)
+	{
+		auto classifier = make_shared<banner_classifier>();
+		if (!classifier->load(signatures_filename))
+		{
+			cerr << "Could not load " << signatures_filename << ": " << strerror(errno) << '\n';
+			return 1;
+		}
+		pool.set_classifier(classifier);
+	}
+
+	uint64_t banners = 0;
+	uint64_t failed = 0;
+
+	pool.set_new_banner([&](const conn_result& result) {
+		banners++;
+		if (quiet)
+			return;
+
+		*out << result.host;
+		if (!result.label.empty())
+			*out << " [" << result.label << ']';
+		*out << ": ";
+		connector::write_escaped(*out, result.banner);
+		*out << '\n';
+	});
+	pool.set_conn_failed([&](const conn_result&, int) { failed++; });
+
+	uint64_t events = 0;
+	uint64_t recorded_us = 0;
+	auto start = chrono::steady_clock::now();
+
+	for (int i = 0; i < repeat; i++)
+	{
+		trace_record r;
+
+		reader.rewind();
+		while (reader.next(r))
+		{
+			events++;
+			if (i == 0)
+				recorded_us += r.delay_us;
+
+			if (r.type == trace_event::open)
+			{
+				char host[INET_ADDRSTRLEN];
+				inet_ntop(AF_INET, &r.addr, host, sizeof(host));
+
+				backend.expect(r.id);
+				pool.connect(host, r.port, 0, r.id);
+			}
+			else
+			{
+				backend.feed(r);
+				pool.check_sockets(0);
+			}
+		}
+
+		if (reader.truncated() && i == 0)
+			cerr << "Trace is cut short, playing what's there\n";
+
+		backend.finish();
+		while (pool.get_queue_size())
+			pool.check_sockets(0);
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	out->flush();
+
+	cerr << events << " events, " << banners << " banners, " << failed << " failed in "
+	     << elapsed.count() << " s (" << (uint64_t) (events / elapsed.count()) << " events/s); recorded over "
+	     << recorded_us / 1e6 << " s\n";
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rescan.h"
+#include "atomic_write.h"
+#include "hash.h"
+
+using namespace std;
+
+static const char magic[8] = { 'C', 'O', 'N', 'N', 'I', 'D', 'X', '1' };
+
+/* File layout: magic, port, a reserved word, entry count, and then the entries
+ * sorted by address. Everything is in host byte order. */
+struct index_header
+{
+	char magic[8];
+	uint32_t port;
+	uint32_t reserved;
+	uint64_t count;
+};
+
+banner_index::~banner_index()
+{
+	if (map)
+		munmap(map, map_size);
+}
+
+bool banner_index::load(const string& filename, int port)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return false;
+	}
+
+	if ((size_t) st.st_size < sizeof(index_header))
+	{
+		close(fd);
+		errno = EINVAL;
+		return false;
+	}
+
+	void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return false;
+
+	const index_header* h = (const index_header*) m;
+	if (memcmp(h->magic, magic, sizeof(magic)) || h->port != (uint32_t) port ||
+			h->count != (st.st_size - sizeof(index_header)) / sizeof(entry))
+	{
+		munmap(m, st.st_size);
+		errno = EINVAL;
+		return false;
+	}
+
+	map = m;
+	map_size = st.st_size;
+	old = (const entry*) (h + 1);
+	n_old = h->count;
+	flags.assign(n_old, 0);
+
+	return true;
+}
+
+const banner_index::entry* banner_index::find(uint32_t addr)
+{
+	const entry* e = lower_bound(old, old + n_old, addr,
+			[](const entry& e, uint32_t addr) { return e.addr < addr; });
+
+	return e != old + n_old && e->addr == addr ? e : nullptr;
+}
+
+void banner_index::attempted(uint32_t addr)
+{
+	const entry* e = find(addr);
+	if (e)
+		flags[e - old] |= flag_attempted;
+}
+
+banner_index::change banner_index::update(uint32_t addr, string_view banner)
+{
+	uint64_t h = fnv1a(banner);
+	fresh.push_back(entry { addr, 0, h });
+
+	const entry* e = find(addr);
+	if (!e)
+		return change::added;
+
+	flags[e - old] |= flag_attempted | flag_seen;
+	if (e->hash != h)
+		return change::changed;
+
+	unchanged++;
+	return change::unchanged;
+}
+
+void banner_index::for_each_gone(const function<void(uint32_t addr)>& f)
+{
+	for (size_t i = 0; i < n_old; i++)
+	{
+		if (flags[i] == flag_attempted)
+			f(old[i].addr);
+	}
+}
+
+bool banner_index::save(const string& filename, int port)
+{
+	/* If a host came up more than once, the last banner wins */
+	stable_sort(fresh.begin(), fresh.end(),
+			[](const entry& a, const entry& b) { return a.addr < b.addr; });
+
+	/* The old index stays mapped until the new one has replaced it */
+	return atomic_write(filename, [&](ostream& out) {
+		index_header h;
+		memcpy(h.magic, magic, sizeof(magic));
+		h.port = port;
+		h.reserved = 0;
+		h.count = 0;
+		out.write((char*) &h, sizeof(h));
+
+		/* Merge the old entries that weren't scanned again with the new ones */
+		size_t i = 0, j = 0;
+		while (i < n_old || j < fresh.size())
+		{
+			if (i < n_old && (flags[i] & flag_attempted))
+			{
+				i++;
+				continue;
+			}
+
+			const entry* e;
+			if (j == fresh.size() || (i < n_old && old[i].addr < fresh[j].addr))
+			{
+				e = &old[i++];
+			}
+			else
+			{
+				/* Skip to the last of its duplicates, and past any old entry for it */
+				while (j + 1 < fresh.size() && fresh[j + 1].addr == fresh[j].addr)
+					j++;
+				if (i < n_old && old[i].addr == fresh[j].addr)
+					i++;
+				e = &fresh[j++];
+			}
+
+			out.write((const char*) e, sizeof(entry));
+			h.count++;
+		}
+
+		out.seekp(0);
+		out.write((char*) &h, sizeof(h));
+	});
+}
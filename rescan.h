@@ -0,0 +1,66 @@
+#ifndef RESCAN_H
+#define RESCAN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/* A hash of every host's banner from the previous scan, so a rescan only has
+ * to report what changed. The old index is mapped straight from its file;
+ * what this scan finds is collected separately and merged into the new one
+ * on save(). Hosts this scan didn't get to are carried over unchanged. */
+class banner_index
+{
+public:
+	enum class change
+	{
+		added,
+		changed,
+		unchanged,
+	};
+
+	~banner_index();
+
+	bool load(const std::string& filename, int port);
+	bool save(const std::string& filename, int port);
+
+	/* The target is being scanned, so if it doesn't answer, it's gone */
+	void attempted(uint32_t addr);
+
+	change update(uint32_t addr, std::string_view banner);
+
+	/* Hosts that were attempted, but didn't come up with a banner this time */
+	void for_each_gone(const std::function<void(uint32_t addr)>& f);
+
+	size_t get_unchanged() { return unchanged; }
+
+private:
+	struct entry
+	{
+		uint32_t addr;
+		uint32_t reserved;
+		uint64_t hash;
+	};
+
+	/* Per old entry */
+	enum
+	{
+		flag_attempted = 1,
+		flag_seen = 2,
+	};
+
+	const entry* find(uint32_t addr);
+
+	void* map = nullptr;
+	size_t map_size = 0;
+	const entry* old = nullptr;
+	size_t n_old = 0;
+	std::vector<uint8_t> flags;
+
+	std::vector<entry> fresh;
+	size_t unchanged = 0;
+};
+
+#endif /* RESCAN_H */
@@ -0,0 +1,83 @@
+#include <errno.h>
+#include <algorithm>
+
+#include "retry.h"
+
+using namespace std;
+
+retry_queue::retry_queue()
+	: rng(random_device()())
+{ }
+
+bool retry_queue::retryable(int err)
+{
+	switch (err)
+	{
+		/* Lost packets, flapping routes or local resource shortage */
+		case ETIMEDOUT:
+		case EHOSTUNREACH:
+		case ENETUNREACH:
+		case EHOSTDOWN:
+		case ENETDOWN:
+		case EAGAIN:
+		case ENOBUFS:
+			return true;
+
+		/* Refused means there's an answer, and it's 'no' */
+		case ECONNREFUSED:
+		default:
+			return false;
+	}
+}
+
+bool retry_queue::schedule(const string& host, int attempt, uint64_t tag, int err)
+{
+	if (attempt >= max_retries || !retryable(err))
+		return false;
+
+	/* Exponential backoff, jittered between 50% and 150% so retries don't bunch up */
+	long delay = (long) backoff_ms << min(attempt, 16);
+	uniform_int_distribution<long> jitter(delay / 2, delay + delay / 2);
+
+	auto due = chrono::high_resolution_clock::now() + chrono::milliseconds(jitter(rng));
+	queue.emplace(due, retry_entry { host, attempt + 1, tag });
+
+	return true;
+}
+
+bool retry_queue::pop_due(chrono::time_point<chrono::high_resolution_clock> now, string& host, int& attempt, uint64_t& tag)
+{
+	if (queue.empty() || queue.begin()->first > now)
+		return false;
+
+	auto& entry = queue.begin()->second;
+	host = entry.host;
+	attempt = entry.attempt;
+	tag = entry.tag;
+
+	queue.erase(queue.begin());
+
+	return true;
+}
+
+int retry_queue::next_due_ms(chrono::time_point<chrono::high_resolution_clock> now)
+{
+	if (queue.empty())
+		return -1;
+
+	auto wait = chrono::duration_cast<chrono::milliseconds>(queue.begin()->first - now).count();
+
+	return wait > 0 ? wait : 0;
+}
+
+bool retry_queue::get_min_tag(uint64_t& tag)
+{
+	if (queue.empty())
+		return false;
+
+	tag = UINT64_MAX;
+	for (auto& it: queue)
+		tag = min(tag, it.second.tag);
+
+	return true;
+}
@@ -0,0 +1,47 @@
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+/* Holds targets whose connection failed for a reason that might go away,
+ * until their (jittered, exponential) backoff has passed. */
+class retry_queue
+{
+public:
+	retry_queue();
+
+	static bool retryable(int err);
+
+	bool schedule(const std::string& host, int attempt, uint64_t tag, int err);
+	bool pop_due(std::chrono::time_point<std::chrono::high_resolution_clock> now, std::string& host, int& attempt, uint64_t& tag);
+	bool get_min_tag(uint64_t& tag);
+	int next_due_ms(std::chrono::time_point<std::chrono::high_resolution_clock> now);
+
+	size_t size() { return queue.size(); }
+
+	inline void set_max_retries(int max_retries) { this->max_retries = max_retries; }
+	inline int get_max_retries() { return max_retries; }
+
+	inline void set_backoff_ms(int backoff_ms) { this->backoff_ms = backoff_ms; }
+	inline int get_backoff_ms() { return backoff_ms; }
+
+private:
+	struct retry_entry
+	{
+		std::string host;
+		int attempt;
+		uint64_t tag;
+	};
+
+	int max_retries = 0;
+	int backoff_ms = 1000;
+
+	std::minstd_rand rng;
+	std::multimap<std::chrono::time_point<std::chrono::high_resolution_clock>, retry_entry> queue;
+};
+
+#endif /* RETRY_H */
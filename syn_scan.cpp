@@ -0,0 +1,258 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <random>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "syn_scan.h"
+
+using namespace std;
+
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+syn_scanner::syn_scanner(int port)
+	: port(port)
+{
+	rawfd = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK, IPPROTO_TCP);
+	if (rawfd == -1)
+		throw errno;
+
+	/* Replies come in bursts, and are only picked up between polls */
+	int bufsize = 4 * 1024 * 1024;
+	setsockopt(rawfd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+	/* Used only to have the kernel tell us which source address it would use */
+	routefd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (routefd == -1)
+	{
+		int err = errno;
+		close(rawfd);
+		throw err;
+	}
+
+	random_device rd;
+	secret = rd();
+	sport = 40000 + rd() % 20000;
+}
+
+syn_scanner::~syn_scanner()
+{
+	close(routefd);
+	close(rawfd);
+}
+
+uint32_t syn_scanner::cookie(uint32_t daddr)
+{
+	uint32_t h = daddr ^ secret;
+	h ^= (uint32_t) port << 16 | sport;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+uint32_t syn_scanner::source_for(uint32_t daddr)
+{
+	/* Addresses in the same /24 are assumed to share a route */
+	uint32_t net = ntohl(daddr) & 0xffffff00;
+	if (route_src && net == route_net)
+		return route_src;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = daddr;
+
+	if (connect(routefd, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+		return 0;
+
+	socklen_t addr_size = sizeof(addr);
+	if (getsockname(routefd, (struct sockaddr*) &addr, &addr_size) == -1)
+		return 0;
+
+	route_net = net;
+	route_src = addr.sin_addr.s_addr;
+
+	return route_src;
+}
+
+uint16_t syn_scanner::checksum(uint32_t saddr, uint32_t daddr, const unsigned char* tcp, size_t len)
+{
+	uint32_t sum = 0;
+
+	/* Pseudo header */
+	sum += (ntohl(saddr) >> 16) + (ntohl(saddr) & 0xffff);
+	sum += (ntohl(daddr) >> 16) + (ntohl(daddr) & 0xffff);
+	sum += IPPROTO_TCP;
+	sum += len;
+
+	for (size_t i = 0; i + 1 < len; i += 2)
+		sum += tcp[i] << 8 | tcp[i + 1];
+	if (len & 1)
+		sum += tcp[len - 1] << 8;
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return htons(~sum);
+}
+
+bool syn_scanner::probe(const char* host, uint64_t tag)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+		return false;
+
+	uint32_t daddr = addr.sin_addr.s_addr;
+	uint32_t saddr = source_for(daddr);
+	if (!saddr)
+		return false;
+
+	uint32_t seq = htonl(cookie(daddr));
+	uint16_t dport = htons(port);
+	uint16_t nsport = htons(sport);
+
+	/* 20 byte TCP header, followed by an MSS option */
+	unsigned char pkt[24];
+	memset(pkt, 0, sizeof(pkt));
+	memcpy(pkt + 0, &nsport, 2);
+	memcpy(pkt + 2, &dport, 2);
+	memcpy(pkt + 4, &seq, 4);
+	pkt[12] = (sizeof(pkt) / 4) << 4;
+	pkt[13] = TCP_SYN;
+	pkt[14] = 0xff;
+	pkt[15] = 0xff;
+	pkt[20] = 2;
+	pkt[21] = 4;
+	pkt[22] = 1460 >> 8;
+	pkt[23] = 1460 & 0xff;
+
+	uint16_t sum = checksum(saddr, daddr, pkt, sizeof(pkt));
+	memcpy(pkt + 16, &sum, 2);
+
+	if (sendto(rawfd, pkt, sizeof(pkt), 0, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+		return false;
+
+	sent.emplace_back(chrono::steady_clock::now(), tag);
+
+	return true;
+}
+
+void syn_scanner::expire(chrono::time_point<chrono::steady_clock> now)
+{
+	while (!sent.empty() && now - sent.front().first >= chrono::milliseconds(wait_ms))
+	{
+		expired_tag = sent.front().second;
+		sent.pop_front();
+	}
+
+	while (!seen_order.empty() && now - seen_order.front().first >= chrono::milliseconds(wait_ms))
+	{
+		seen.erase(seen_order.front().second);
+		seen_order.pop_front();
+	}
+}
+
+void syn_scanner::check_responses()
+{
+	unsigned char buffer[1500];
+
+	for (;;)
+	{
+		ssize_t n = recv(rawfd, buffer, sizeof(buffer), 0);
+		if (n == -1)
+			break;
+
+		if (n < 20 || buffer[9] != IPPROTO_TCP)
+			continue;
+
+		size_t ihl = (buffer[0] & 0x0f) * 4;
+		if ((size_t) n < ihl + 20)
+			continue;
+
+		unsigned char* tcp = buffer + ihl;
+
+		uint32_t saddr;
+		uint16_t th_sport, th_dport;
+		uint32_t ack;
+		memcpy(&saddr, buffer + 12, 4);
+		memcpy(&th_sport, tcp + 0, 2);
+		memcpy(&th_dport, tcp + 2, 2);
+		memcpy(&ack, tcp + 8, 4);
+
+		if (ntohs(th_sport) != port || ntohs(th_dport) != sport)
+			continue;
+
+		uint8_t flags = tcp[13];
+		if ((flags & (TCP_SYN | TCP_ACK | TCP_RST)) != (TCP_SYN | TCP_ACK))
+			continue;
+
+		/* Not one of ours */
+		if (ntohl(ack) != cookie(saddr) + 1)
+			continue;
+
+		if (!seen.insert(saddr).second)
+			continue;
+		seen_order.emplace_back(chrono::steady_clock::now(), saddr);
+
+		open.emplace_back(saddr, sent.empty() ? expired_tag : sent.front().second);
+		total_open++;
+	}
+
+	expire(chrono::steady_clock::now());
+}
+
+bool syn_scanner::wait(int timeout)
+{
+	struct pollfd pfd;
+	pfd.fd = rawfd;
+	pfd.events = POLLIN;
+
+	if (poll(&pfd, 1, timeout) == -1 && errno != EINTR)
+		return false;
+
+	check_responses();
+
+	return true;
+}
+
+bool syn_scanner::pop_open(string& host, uint64_t& tag)
+{
+	if (open.empty())
+		return false;
+
+	struct in_addr addr;
+	addr.s_addr = open.front().first;
+	tag = open.front().second;
+	open.pop_front();
+
+	host = inet_ntoa(addr);
+
+	return true;
+}
+
+bool syn_scanner::get_min_tag(uint64_t& tag)
+{
+	if (!busy())
+		return false;
+
+	tag = UINT64_MAX;
+	if (!sent.empty())
+		tag = sent.front().second;
+	for (auto& o: open)
+		tag = min(tag, o.second);
+
+	return true;
+}
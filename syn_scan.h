@@ -0,0 +1,65 @@
+#ifndef SYN_SCAN_H
+#define SYN_SCAN_H
+
+#include <deque>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <unordered_set>
+
+/* Stateless SYN sweep. Each probe's sequence number is a cookie derived from the
+ * destination, so SYN-ACKs can be validated without remembering what was sent. */
+class syn_scanner
+{
+public:
+	syn_scanner(int port);
+	~syn_scanner();
+
+	bool probe(const char* host, uint64_t tag = 0);
+	void check_responses();
+	bool wait(int timeout);
+
+	bool pop_open(std::string& host, uint64_t& tag);
+	bool get_min_tag(uint64_t& tag);
+
+	size_t get_open_count() { return open.size(); }
+	bool busy() { return !sent.empty() || !open.empty(); }
+
+	int get_total_open() { return total_open; }
+
+	inline void set_wait_ms(int wait_ms) { this->wait_ms = wait_ms; }
+	inline int get_wait_ms() { return wait_ms; }
+
+private:
+	uint32_t cookie(uint32_t daddr);
+	uint32_t source_for(uint32_t daddr);
+	void expire(std::chrono::time_point<std::chrono::steady_clock> now);
+
+	static uint16_t checksum(uint32_t saddr, uint32_t daddr, const unsigned char* tcp, size_t len);
+
+	int rawfd;
+	int routefd;
+	int port;
+	uint16_t sport;
+	uint32_t secret;
+	int wait_ms = 1000;
+	int total_open = 0;
+
+	uint32_t route_net = 0;
+	uint32_t route_src = 0;
+
+	/* Only send times (and the caller's tags) are kept, to know when the last
+	 * SYN-ACKs can be expected. Answers can't be matched to a probe, so they get
+	 * the tag of the oldest probe still waiting, which normally isn't newer. */
+	std::deque<std::pair<std::chrono::time_point<std::chrono::steady_clock>, uint64_t>> sent;
+	uint64_t expired_tag = 0;
+
+	/* SYN-ACK retransmissions shouldn't result in duplicate connections. Hosts
+	 * are forgotten again after the wait, oldest first. */
+	std::unordered_set<uint32_t> seen;
+	std::deque<std::pair<std::chrono::time_point<std::chrono::steady_clock>, uint32_t>> seen_order;
+
+	std::deque<std::pair<uint32_t, uint64_t>> open;
+};
+
+#endif /* SYN_SCAN_H */
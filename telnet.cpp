@@ -1,6 +1,7 @@
 #include <unistd.h>
 
 #include "telnet.h"
+#include "negotiator_slot.h"
 
 using namespace std;
 
@@ -16,81 +17,52 @@ using namespace std;
 
 telnet_negotiator::telnet_negotiator(int sockfd)
 	: sockfd(sockfd)
-{ }
-
-string telnet_negotiator::crunch(unsigned char* buffer, size_t n)
 {
-	string s;
+	start(run());
+}
 
-	for (size_t i = 0; i < n; i++)
+coro_negotiator::task telnet_negotiator::run()
+{
+	for (;;)
 	{
-		unsigned char ch = buffer[i];
+		unsigned char ch = co_await read_byte();
 
-		switch(st)
+		if (ch != CMD)
 		{
-			case state::normal:
-				if (ch == CMD)
-				{
-					st = state::cmd1;
-					break;
-				}
-
-				if (ch)
-					s += ch;
-
-				break;
-			case state::cmd1:
-				/* CMD received. Next is DO/DONT/etc... */
-				cmd = ch;
-				st = state::cmd2;
-				break;
-			case state::cmd2:
-				/* XXX: BEGIN - Stolen from http://l3net.wordpress.com/2012/12/09/a-simple-telnet-client */
-				if (cmd == DO && ch == CMD_WINDOW_SIZE)
-				{
-					write_queue.push(vector<unsigned char> 
-							{255, 251, 31});
+			if (ch)
+				emit(ch);
 
-					write_queue.push(vector<unsigned char> 
-							{255, 250, 31, 0, 80, 0, 24, 255, 240});
-				}
-				else
-				{
-					// XXX: This seem weird at all?
-					if (cmd == DO)
-						cmd = WONT;
-					else if (cmd == WILL)
-						cmd = DO;
-
-					write_queue.push(vector<unsigned char> { 0xff, cmd, ch, });
-				}
-				/* XXX: END - Stolen */
+			continue;
+		}
 
-				/* Back to normal */
-				st = state::normal;
+		/* CMD received. Next is DO/DONT/etc... */
+		unsigned char cmd = co_await read_byte();
+		ch = co_await read_byte();
 
-				break;
+		/* XXX: BEGIN - Stolen from http://l3net.wordpress.com/2012/12/09/a-simple-telnet-client */
+		if (cmd == DO && ch == CMD_WINDOW_SIZE)
+		{
+			write({255, 251, 31});
+			write({255, 250, 31, 0, 80, 0, 24, 255, 240});
 		}
+		else
+		{
+			// XXX: This seem weird at all?
+			if (cmd == DO)
+				cmd = WONT;
+			else if (cmd == WILL)
+				cmd = DO;
 
+			write({ 0xff, cmd, ch, });
+		}
+		/* XXX: END - Stolen */
 	}
-
-	return s;
-}
-
-bool telnet_negotiator::has_write_data()
-{
-	return !write_queue.empty();
-}
-
-std::vector<unsigned char> telnet_negotiator::pop_write_queue()
-{
-	auto top = write_queue.front();
-	write_queue.pop();
-
-	return top;
 }
 
-std::shared_ptr<negotiator> telnet_provider::provide(int sockfd)
+void telnet_provider::provide(negotiator_slot& slot, int sockfd)
 {
-	return make_shared<telnet_negotiator>(sockfd);
+	if (boxed)
+		slot = make_shared<telnet_negotiator>(sockfd);
+	else
+		slot.emplace<telnet_negotiator>(sockfd);
 }
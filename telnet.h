@@ -3,44 +3,34 @@
 
 #include <memory>
 #include <string>
-#include <queue>
 
 #include "negotiator.h"
+#include "coro.h"
 
-class telnet_negotiator : public negotiator
+class telnet_negotiator final : public coro_negotiator
 {
 public:
 	telnet_negotiator(int sockfd);
 
 	~telnet_negotiator() override { }
 
-	std::string crunch(unsigned char* buffer, size_t n) override;
-
-	bool has_write_data() override;
-	std::vector<unsigned char> pop_write_queue() override;
-
 private:
-	enum class state
-	{
-		normal,
-		cmd1,
-		cmd2,
-	};
+	task run();
 
 	int sockfd;
-	unsigned char cmd;
-	state st = state::normal;
-
-	std::queue<std::vector<unsigned char>> write_queue;
 };
 
 class telnet_provider: public negotiator_provider
 {
 public: 
+	/* boxed puts the negotiator behind a shared_ptr, i.e. virtual calls */
+	telnet_provider(bool boxed = false) : boxed(boxed) { }
 	~telnet_provider() override { }
 
-	std::shared_ptr<negotiator> provide(int sockfd) override;
+	void provide(negotiator_slot& slot, int sockfd) override;
+
+private:
+	bool boxed;
 };
 
 #endif /* TELNET_H */
-
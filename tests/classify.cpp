@@ -0,0 +1,139 @@
+#include <unistd.h>
+#include <ctype.h>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "classify.h"
+
+using namespace std;
+
+/* Checks banner_classifier against trying every signature in file order with
+ * string::find(). Patterns and banners come from a small alphabet, so they
+ * overlap, nest and share prefixes a lot; it has both cases of a letter, and
+ * bytes that need escaping. */
+
+static const char hex_digits[] = "0123456789abcdef";
+
+struct signature
+{
+	string pattern;
+	bool fold;
+};
+
+static string lower(string s)
+{
+	for (auto& c: s)
+		c = tolower((unsigned char) c);
+
+	return s;
+}
+
+static int naive_classify(const vector<signature>& sigs, const string& banner)
+{
+	string folded = lower(banner);
+
+	for (size_t i = 0; i < sigs.size(); i++)
+	{
+		if (sigs[i].fold ? folded.find(lower(sigs[i].pattern)) != string::npos :
+				banner.find(sigs[i].pattern) != string::npos)
+			return i;
+	}
+
+	return -1;
+}
+
+static string random_string(mt19937& rng, const string& alphabet, size_t min_len, size_t max_len)
+{
+	string s(min_len + rng() % (max_len - min_len + 1), ' ');
+	for (auto& c: s)
+		c = alphabet[rng() % alphabet.size()];
+
+	return s;
+}
+
+static bool check(const char* name, const string& alphabet, int n_sigs, int max_len, mt19937& rng)
+{
+	vector<signature> sigs;
+	for (int i = 0; i < n_sigs; i++)
+		sigs.push_back(signature { random_string(rng, alphabet, 1, max_len), rng() % 3 == 0 });
+
+	char tmp[] = "/tmp/connector-test-XXXXXX";
+	int fd = mkstemp(tmp);
+	if (fd == -1)
+		return false;
+	close(fd);
+
+	{
+		/* Everything escaped, so the file format can't get in the way */
+		ofstream out(tmp);
+		out << "# generated\n";
+		for (size_t i = 0; i < sigs.size(); i++)
+		{
+			out << "sig" << i << '\t';
+			for (unsigned char c: sigs[i].pattern)
+				out << "\\x" << hex_digits[c >> 4] << hex_digits[c & 0xf];
+			out << (sigs[i].fold ? "\ti" : "") << '\n';
+		}
+	}
+
+	banner_classifier classifier;
+	bool loaded = classifier.load(tmp);
+	unlink(tmp);
+
+	if (!loaded || classifier.size() != sigs.size())
+	{
+		cerr << name << ": could not load the signatures\n";
+		return false;
+	}
+
+	for (int i = 0; i < 20000; i++)
+	{
+		string banner = random_string(rng, alphabet, 0, 40);
+
+		/* Plant one, in a random case, half of the time */
+		if (rng() % 2)
+		{
+			string p = sigs[rng() % sigs.size()].pattern;
+			for (auto& c: p)
+				c = rng() % 2 ? toupper((unsigned char) c) : c;
+			banner.insert(rng() % (banner.size() + 1), p);
+		}
+
+		int expected = naive_classify(sigs, banner);
+		const string* label = classifier.classify(banner);
+		string got = label ? *label : "(none)";
+		string want = expected >= 0 ? "sig" + to_string(expected) : "(none)";
+
+		if (got != want)
+		{
+			cerr << name << ": banner ";
+			for (unsigned char c: banner)
+			{
+				if (isprint(c))
+					cerr << c;
+				else
+					cerr << "\\x" << hex_digits[c >> 4] << hex_digits[c & 0xf];
+			}
+			cerr << " got " << got << ", expected " << want << '\n';
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main()
+{
+	mt19937 rng(1);
+
+	bool ok = true;
+	ok &= check("two letters", "ab", 10, 4, rng);
+	ok &= check("cases", "aAbB", 20, 5, rng);
+	ok &= check("bytes", string("aB\0\n\\\t\xff", 7), 30, 6, rng);
+	ok &= check("many", "abcdABCD01", 300, 8, rng);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <utility>
+
+#include "exclude.h"
+
+using namespace std;
+
+/* Checks cidr_set's /16 index and search against a plain scan over every
+ * range that was added, on sets that are sparse, dense within one /16, and
+ * made of ranges spanning many /16s. */
+
+typedef vector<pair<uint32_t, uint32_t>> range_list;
+
+static bool naive_contains(const range_list& rs, uint32_t addr)
+{
+	for (auto& r: rs)
+	{
+		if (r.first <= addr && addr <= r.second)
+			return true;
+	}
+
+	return false;
+}
+
+static bool check(const char* name, const range_list& rs, mt19937& rng)
+{
+	cidr_set set;
+	for (auto& r: rs)
+		set.add(r.first, r.second);
+	set.compile();
+
+	/* Every edge, and just past it, plus random addresses */
+	vector<uint32_t> addrs = { 0, 1, 0xffff, 0x10000, 0xfffffffe, 0xffffffff };
+	for (auto& r: rs)
+	{
+		addrs.insert(addrs.end(), { r.first - 1, r.first, r.first + 1, r.second - 1, r.second, r.second + 1 });
+		addrs.push_back(r.first & 0xffff0000);
+		addrs.push_back(r.first | 0xffff);
+	}
+	for (int i = 0; i < 20000; i++)
+		addrs.push_back(rng());
+
+	for (uint32_t a: addrs)
+	{
+		if (set.contains(a) != naive_contains(rs, a))
+		{
+			cerr << name << ": " << hex << a << dec << " should " << (naive_contains(rs, a) ? "" : "not ")
+			     << "be contained\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static range_list prefixes(mt19937& rng, int n, int min_bits, int max_bits, uint32_t base, uint32_t base_mask)
+{
+	range_list rs;
+	for (int i = 0; i < n; i++)
+	{
+		int bits = min_bits + rng() % (max_bits - min_bits + 1);
+		uint32_t mask = bits ? ~0u << (32 - bits) : 0;
+		uint32_t first = ((rng() & ~base_mask) | base) & mask;
+		rs.emplace_back(first, first | ~mask);
+	}
+
+	return rs;
+}
+
+static bool check_load()
+{
+	char tmp[] = "/tmp/connector-test-XXXXXX";
+	int fd = mkstemp(tmp);
+	if (fd == -1)
+		return false;
+	close(fd);
+
+	{
+		ofstream out(tmp);
+		out << "# comment\n\n10.0.0.0/8\n 192.168.1.1 # one host\n172.16.0.0/12\n";
+	}
+
+	cidr_set set;
+	bool ok = set.load(tmp) && set.size() == 3 &&
+		set.contains("10.255.255.255") && !set.contains("11.0.0.0") &&
+		set.contains("192.168.1.1") && !set.contains("192.168.1.2") &&
+		set.contains("172.31.0.1") && !set.contains("172.32.0.0") &&
+		!set.contains("not an address");
+
+	{
+		ofstream out(tmp);
+		out << "10.0.0.0/33\n";
+	}
+	ok = ok && !set.load(tmp);
+
+	unlink(tmp);
+
+	if (!ok)
+		cerr << "load: wrong result\n";
+
+	return ok;
+}
+
+int main()
+{
+	mt19937 rng(1);
+
+	bool ok = true;
+	ok &= check("empty", range_list(), rng);
+	ok &= check("everything", { { 0, 0xffffffff } }, rng);
+	ok &= check("edges", { { 0, 0 }, { 0xffffffff, 0xffffffff }, { 0xffff, 0x10000 } }, rng);
+	ok &= check("adjacent", { { 100, 199 }, { 200, 299 }, { 300, 300 }, { 302, 400 } }, rng);
+	ok &= check("sparse", prefixes(rng, 500, 24, 32, 0, 0), rng);
+	ok &= check("one /16", prefixes(rng, 2000, 24, 32, 0x0a0b0000, 0xffff0000), rng);
+	ok &= check("wide", prefixes(rng, 200, 8, 20, 0, 0), rng);
+	ok &= check("mixed", prefixes(rng, 2000, 12, 32, 0, 0), rng);
+	ok &= check_load();
+
+	return ok ? 0 : 1;
+}
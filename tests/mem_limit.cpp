@@ -0,0 +1,84 @@
+#include <unistd.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "connector.h"
+
+using namespace std;
+
+/* Scans a loopback listener with a --mem-limit smaller than one arena chunk.
+ * Every target has to come back with a banner; before, intake stopped for
+ * good once the pool had emptied, and the scan never finished. */
+
+static const int targets = 20;
+
+int main()
+{
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr = { };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	socklen_t len = sizeof(addr);
+	if (bind(lfd, (sockaddr*) &addr, sizeof(addr)) == -1 || listen(lfd, targets) == -1 ||
+			getsockname(lfd, (sockaddr*) &addr, &len) == -1)
+	{
+		cerr << "listener: " << strerror(errno) << '\n';
+		return 1;
+	}
+
+	thread server([lfd]() {
+		for (int i = 0; i < targets; i++)
+		{
+			int fd = accept(lfd, nullptr, nullptr);
+			if (fd == -1)
+				return;
+
+			const char banner[] = "router login: ";
+			if (write(fd, banner, sizeof(banner) - 1) == -1)
+				perror("write()");
+			close(fd);
+		}
+	});
+
+	stringstream input;
+	for (int i = 0; i < targets; i++)
+		input << "127.0.0.1\n";
+
+	ostringstream output;
+	connector c(input, output, ntohs(addr.sin_port));
+	c.set_maxcon(5);
+	c.set_conn_rate(1000);
+	c.set_mem_limit(64 * 1024);
+	c.set_prov(make_negotiator_provider("telnet"));
+	c.run();
+
+	server.join();
+	close(lfd);
+
+	int banners = 0;
+	istringstream lines(output.str());
+	string line;
+	while (getline(lines, line))
+	{
+		if (line != "127.0.0.1: router login: ")
+		{
+			cerr << "\nUnexpected line: " << line << '\n';
+			return 1;
+		}
+		banners++;
+	}
+
+	if (banners != targets)
+	{
+		cerr << "\nExpected " << targets << " banners, got " << banners << '\n';
+		return 1;
+	}
+
+	return 0;
+}
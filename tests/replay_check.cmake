@@ -0,0 +1,17 @@
+# Plays TRACE through connector-replay (REPLAY) with ARGS, and fails unless the
+# banners it writes are exactly EXPECTED.
+separate_arguments(ARGS)
+execute_process(COMMAND ${REPLAY} ${ARGS} ${TRACE}
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE errors
+	RESULT_VARIABLE result)
+
+file(READ ${EXPECTED} expected)
+
+if (NOT result EQUAL 0)
+	message(FATAL_ERROR "connector-replay failed (${result}): ${errors}")
+endif ()
+
+if (NOT output STREQUAL expected)
+	message(FATAL_ERROR "Expected:\n${expected}\nGot:\n${output}")
+endif ()
@@ -0,0 +1,163 @@
+#include <unistd.h>
+#include <errno.h>
+#include <iostream>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rescan.h"
+
+using namespace std;
+
+/* Runs a series of rescans through banner_index (load, attempted/update,
+ * for_each_gone, save), next to a plain map of what the index should hold.
+ * Every scan only covers part of the hosts, some hosts come up twice, and
+ * banners change now and then, so the merge in save() sees every case. */
+
+static const int port = 23;
+
+static const char* name(banner_index::change c)
+{
+	switch (c)
+	{
+		case banner_index::change::added: return "added";
+		case banner_index::change::changed: return "changed";
+		case banner_index::change::unchanged: return "unchanged";
+	}
+
+	return "?";
+}
+
+/* What a fresh load of the file says about every host */
+static bool verify(const string& filename, const vector<uint32_t>& hosts, const map<uint32_t, string>& expected, int round)
+{
+	banner_index index;
+	if (!index.load(filename, port))
+	{
+		cerr << "round " << round << ": could not reload the index\n";
+		return false;
+	}
+
+	for (uint32_t addr: hosts)
+	{
+		auto it = expected.find(addr);
+		auto want = it == expected.end() ? banner_index::change::added : banner_index::change::unchanged;
+		auto got = index.update(addr, it == expected.end() ? string("new") : it->second);
+
+		if (got != want)
+		{
+			cerr << "round " << round << ": host " << addr << " is " << name(got) << ", expected " << name(want) << '\n';
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main()
+{
+	char dir[] = "/tmp/connector-test-XXXXXX";
+	if (!mkdtemp(dir))
+	{
+		perror("mkdtemp()");
+		return 1;
+	}
+	string filename = string(dir) + "/index";
+
+	mt19937 rng(1);
+
+	/* Spread out, so they land all over the sorted file, and include both ends */
+	vector<uint32_t> hosts = { 0, 0xffffffff };
+	while (hosts.size() < 300)
+		hosts.push_back(rng());
+
+	map<uint32_t, string> model;
+	bool ok = true;
+
+	for (int round = 0; round < 30 && ok; round++)
+	{
+		banner_index index;
+		if (!index.load(filename, port) && !(round == 0 && errno == ENOENT))
+		{
+			cerr << "round " << round << ": could not load the index\n";
+			ok = false;
+			break;
+		}
+
+		map<uint32_t, string> next = model;
+		set<uint32_t> attempted;
+		set<uint32_t> seen;
+
+		for (uint32_t addr: hosts)
+		{
+			if (rng() % 3)
+				continue;
+
+			index.attempted(addr);
+			attempted.insert(addr);
+			next.erase(addr);
+
+			/* Most answer; some twice, and the last banner is the one to keep */
+			int answers = rng() % 4 == 0 ? 0 : rng() % 4 == 0 ? 2 : 1;
+			for (int i = 0; i < answers; i++)
+			{
+				string banner = rng() % 4 ? "banner " + to_string(addr % 5) : "banner " + to_string(rng());
+
+				auto it = model.find(addr);
+				auto want = it == model.end() ? banner_index::change::added :
+					it->second == banner ? banner_index::change::unchanged : banner_index::change::changed;
+				auto got = index.update(addr, banner);
+
+				if (got != want)
+				{
+					cerr << "round " << round << ": update of " << addr << " is " << name(got) << ", expected " << name(want) << '\n';
+					ok = false;
+				}
+
+				next[addr] = banner;
+				seen.insert(addr);
+			}
+		}
+
+		set<uint32_t> gone;
+		index.for_each_gone([&](uint32_t addr) { gone.insert(addr); });
+
+		set<uint32_t> want_gone;
+		for (uint32_t addr: attempted)
+		{
+			if (model.count(addr) && !seen.count(addr))
+				want_gone.insert(addr);
+		}
+
+		if (gone != want_gone)
+		{
+			cerr << "round " << round << ": " << gone.size() << " hosts gone, expected " << want_gone.size() << '\n';
+			ok = false;
+		}
+
+		if (!index.save(filename, port))
+		{
+			cerr << "round " << round << ": could not save the index\n";
+			ok = false;
+			break;
+		}
+
+		model = next;
+		ok = ok && verify(filename, hosts, model, round);
+	}
+
+	/* An index is only good for the port it was made for */
+	banner_index other;
+	if (ok && other.load(filename, port + 1))
+	{
+		cerr << "loaded the index for another port\n";
+		ok = false;
+	}
+
+	unlink(filename.c_str());
+	rmdir(dir);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+#include <unistd.h>
+
+#include "tls.h"
+#include "negotiator_slot.h"
+
+using namespace std;
+
+/* Record types */
+#define TLS_CHANGE_CIPHER_SPEC 0x14
+#define TLS_ALERT 0x15
+#define TLS_HANDSHAKE 0x16
+#define TLS_APPLICATION_DATA 0x17
+
+/* Handshake message types */
+#define TLS_CLIENT_HELLO 1
+#define TLS_SERVER_HELLO 2
+#define TLS_CERTIFICATE 11
+#define TLS_SERVER_HELLO_DONE 14
+
+/* The most we'll buffer for a single handshake message (certificate chains are the big ones) */
+#define TLS_MAX_MESSAGE (64 * 1024)
+
+static void put16(vector<unsigned char>& v, size_t x)
+{
+	v.push_back(x >> 8);
+	v.push_back(x);
+}
+
+/* Fill in a length field at 'at', now that we know how much followed it */
+static void patch(vector<unsigned char>& v, size_t at, size_t bytes)
+{
+	size_t len = v.size() - at - bytes;
+	for (size_t i = 0; i < bytes; i++)
+		v[at + i] = len >> (8 * (bytes - i - 1));
+}
+
+static void extension(vector<unsigned char>& v, uint16_t type, const vector<unsigned char>& data)
+{
+	put16(v, type);
+	put16(v, data.size());
+	v.insert(v.end(), data.begin(), data.end());
+}
+
+/* A TLS 1.2 ClientHello with the cipher suites and extensions a browser would
+ * send, minus SNI, since all we have is an address */
+static vector<unsigned char> build_client_hello()
+{
+	vector<unsigned char> v { TLS_HANDSHAKE, 0x03, 0x01, 0, 0 };
+
+	v.insert(v.end(), { TLS_CLIENT_HELLO, 0, 0, 0 });
+	put16(v, 0x0303);
+
+	/* 'Random'. Nothing is derived from it, so it doesn't have to be. */
+	for (int i = 0; i < 32; i++)
+		v.push_back(i * 7 + 1);
+
+	/* No session id */
+	v.push_back(0);
+
+	const uint16_t ciphers[] = {
+		0xc02f, 0xc030, 0xc02b, 0xc02c, 0xcca8, 0xcca9, 0xc013, 0xc014,
+		0xc009, 0xc00a, 0x009c, 0x009d, 0x002f, 0x0035, 0x000a,
+	};
+	put16(v, sizeof(ciphers));
+	for (uint16_t cipher: ciphers)
+		put16(v, cipher);
+
+	/* Null compression only */
+	v.insert(v.end(), { 1, 0 });
+
+	size_t ext_start = v.size();
+	put16(v, 0);
+	extension(v, 0x000a, { 0, 6, 0x00, 0x1d, 0x00, 0x17, 0x00, 0x18 });	/* supported_groups */
+	extension(v, 0x000b, { 1, 0 });						/* ec_point_formats */
+	extension(v, 0x000d, { 0, 20, 0x04, 0x03, 0x05, 0x03, 0x06, 0x03,	/* signature_algorithms */
+			0x08, 0x04, 0x08, 0x05, 0x08, 0x06, 0x04, 0x01, 0x05, 0x01, 0x06, 0x01, 0x02, 0x01 });
+	extension(v, 0xff01, { 0 });						/* renegotiation_info */
+	patch(v, ext_start, 2);
+
+	patch(v, 5 + 1, 3);
+	patch(v, 3, 2);
+
+	return v;
+}
+
+static const vector<unsigned char> client_hello = build_client_hello();
+
+const size_t tls_negotiator::hello_size = client_hello.size();
+
+tls_negotiator::tls_negotiator(int sockfd)
+	: sockfd(sockfd)
+{
+	write_queue.push(client_hello);
+}
+
+string tls_negotiator::hex(const unsigned char* data, size_t n)
+{
+	const char* digits = "0123456789abcdef";
+	string s;
+	s.reserve(n * 2);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		s += digits[data[i] >> 4];
+		s += digits[data[i] & 0x0f];
+	}
+
+	return s;
+}
+
+string tls_negotiator::field(const string& s)
+{
+	return fields++ ? ' ' + s : s;
+}
+
+string tls_negotiator::crunch(unsigned char* buffer, size_t n)
+{
+	string s;
+
+	if (done)
+		return s;
+
+	record.append((char*) buffer, n);
+
+	while (!done && record.size() >= 5)
+	{
+		const unsigned char* hdr = (const unsigned char*) record.data();
+		size_t len = hdr[3] << 8 | hdr[4];
+
+		if (hdr[0] < TLS_CHANGE_CIPHER_SPEC || hdr[0] > TLS_APPLICATION_DATA || hdr[1] != 3)
+		{
+			s += field("not-tls");
+			done = true;
+			break;
+		}
+
+		if (record.size() < 5 + len)
+			break;
+
+		unsigned char type = hdr[0];
+		string fragment = record.substr(5, len);
+		record.erase(0, 5 + len);
+
+		if (type == TLS_ALERT)
+		{
+			if (fragment.size() >= 2)
+				s += field("alert=" + hex((const unsigned char*) fragment.data(), 2));
+			done = true;
+			break;
+		}
+
+		/* Anything else means the server has moved past the plaintext part */
+		if (type != TLS_HANDSHAKE)
+		{
+			done = true;
+			break;
+		}
+
+		message += fragment;
+
+		while (!done && message.size() >= 4)
+		{
+			const unsigned char* msg = (const unsigned char*) message.data();
+			size_t msg_len = msg[1] << 16 | msg[2] << 8 | msg[3];
+
+			if (msg_len > TLS_MAX_MESSAGE)
+			{
+				s += field("oversized");
+				done = true;
+				break;
+			}
+
+			if (message.size() < 4 + msg_len)
+				break;
+
+			s += handshake(msg[0], message.substr(4, msg_len));
+			message.erase(0, 4 + msg_len);
+		}
+	}
+
+	return s;
+}
+
+string tls_negotiator::handshake(unsigned char type, const string& body)
+{
+	const unsigned char* p = (const unsigned char*) body.data();
+	size_t n = body.size();
+
+	switch (type)
+	{
+		case TLS_SERVER_HELLO:
+		{
+			/* version, random, session id, cipher suite */
+			if (n < 35 || n < (size_t) 35 + p[34] + 2)
+				break;
+
+			string s = field("version=" + hex(p, 2));
+			s += field("cipher=" + hex(p + 35 + p[34], 2));
+
+			return s;
+		}
+
+		case TLS_CERTIFICATE:
+		{
+			/* Length of the chain, and then of the first (leaf) certificate */
+			if (n < 6)
+				break;
+
+			size_t cert_len = p[3] << 16 | p[4] << 8 | p[5];
+			if (n < 6 + cert_len)
+				break;
+
+			return field("cert=" + hex(p + 6, cert_len));
+		}
+
+		case TLS_SERVER_HELLO_DONE:
+			done = true;
+			break;
+	}
+
+	return string();
+}
+
+void tls_provider::provide(negotiator_slot& slot, int sockfd)
+{
+	if (boxed)
+		slot = make_shared<tls_negotiator>(sockfd);
+	else
+		slot.emplace<tls_negotiator>(sockfd);
+}
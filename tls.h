@@ -0,0 +1,68 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <memory>
+#include <string>
+#include <queue>
+
+#include "negotiator.h"
+
+/* Sends a canned ClientHello, and picks the version, cipher and (leaf)
+ * certificate out of the server's reply. There's no crypto involved: we hang
+ * up as soon as the server is done talking in the clear. */
+class tls_negotiator final : public negotiator
+{
+public:
+	tls_negotiator(int sockfd);
+
+	~tls_negotiator() override { }
+
+	std::string crunch(unsigned char* buffer, size_t n) override;
+
+	bool has_write_data() override { return !write_queue.empty(); }
+	std::vector<unsigned char> pop_write_queue() override;
+
+	size_t buffered() override { return record.capacity() + message.capacity() + write_queue.size() * hello_size; }
+
+	bool finished() override { return done; }
+
+private:
+	std::string handshake(unsigned char type, const std::string& body);
+	std::string field(const std::string& s);
+	static std::string hex(const unsigned char* data, size_t n);
+
+	static const size_t hello_size;
+
+	int sockfd;
+	bool done = false;
+	int fields = 0;
+
+	/* Incomplete record, and incomplete handshake message */
+	std::string record;
+	std::string message;
+
+	std::queue<std::vector<unsigned char>> write_queue;
+};
+
+inline std::vector<unsigned char> tls_negotiator::pop_write_queue()
+{
+	auto top = std::move(write_queue.front());
+	write_queue.pop();
+
+	return top;
+}
+
+class tls_provider: public negotiator_provider
+{
+public:
+	/* boxed puts the negotiator behind a shared_ptr, i.e. virtual calls */
+	tls_provider(bool boxed = false) : boxed(boxed) { }
+	~tls_provider() override { }
+
+	void provide(negotiator_slot& slot, int sockfd) override;
+
+private:
+	bool boxed;
+};
+
+#endif /* TLS_H */
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+using namespace std;
+
+static const char magic[8] = { 'C', 'O', 'N', 'N', 'T', 'R', 'C', '1' };
+
+/* Written out once this much has piled up */
+#define TRACE_BUFFER (256 * 1024)
+
+trace_writer::~trace_writer()
+{
+	close();
+}
+
+bool trace_writer::open(const string& filename)
+{
+	f = fopen(filename.c_str(), "w");
+	if (!f)
+		return false;
+
+	buf.reserve(TRACE_BUFFER + 4096);
+	buf.assign(magic, sizeof(magic));
+	last = chrono::steady_clock::now();
+
+	return true;
+}
+
+bool trace_writer::close()
+{
+	if (!f)
+		return true;
+
+	flush();
+	bool ok = !ferror(f);
+	ok &= fclose(f) == 0;
+	f = nullptr;
+
+	return ok;
+}
+
+void trace_writer::varint(uint64_t x)
+{
+	while (x >= 0x80)
+	{
+		buf += (char) (x | 0x80);
+		x >>= 7;
+	}
+	buf += (char) x;
+}
+
+void trace_writer::header(trace_event type, uint32_t id)
+{
+	auto now = chrono::steady_clock::now();
+
+	buf += (char) type;
+	varint(id);
+	varint(chrono::duration_cast<chrono::microseconds>(now - last).count());
+
+	last = now;
+}
+
+void trace_writer::flush()
+{
+	fwrite(buf.data(), 1, buf.size(), f);
+	buf.clear();
+}
+
+uint32_t trace_writer::opened(uint32_t addr, int port)
+{
+	uint32_t id = next_id++;
+
+	header(trace_event::open, id);
+	buf.append((const char*) &addr, 4);
+	varint(port);
+
+	return id;
+}
+
+void trace_writer::connected(uint32_t id, int err)
+{
+	header(trace_event::connect, id);
+	varint(err);
+}
+
+void trace_writer::data(uint32_t id, const void* data, size_t n)
+{
+	header(trace_event::data, id);
+	varint(n);
+	buf.append((const char*) data, n);
+
+	if (buf.size() >= TRACE_BUFFER)
+		flush();
+}
+
+void trace_writer::eof(uint32_t id, int err)
+{
+	header(trace_event::eof, id);
+	varint(err);
+}
+
+void trace_writer::closed(uint32_t id)
+{
+	header(trace_event::close, id);
+
+	if (buf.size() >= TRACE_BUFFER)
+		flush();
+}
+
+trace_reader::~trace_reader()
+{
+	if (map)
+		munmap((void*) map, size);
+}
+
+bool trace_reader::open(const string& filename)
+{
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		::close(fd);
+		return false;
+	}
+
+	size = st.st_size;
+	if (size < sizeof(magic))
+	{
+		::close(fd);
+		errno = EINVAL;
+		return false;
+	}
+
+	void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED)
+		return false;
+
+	map = (const unsigned char*) m;
+	madvise(m, size, MADV_SEQUENTIAL);
+
+	if (memcmp(map, magic, sizeof(magic)) != 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	start = p = map + sizeof(magic);
+	end = map + size;
+
+	return true;
+}
+
+bool trace_reader::varint(uint64_t& x)
+{
+	x = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7)
+	{
+		unsigned char b = *p++;
+		x |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+bool trace_reader::next(trace_record& r)
+{
+	if (p == end)
+		return false;
+
+	const unsigned char* rec = p;
+	if (parse(r))
+		return true;
+
+	/* Leave it pointing at the record that didn't make sense */
+	p = rec;
+	return false;
+}
+
+bool trace_reader::parse(trace_record& r)
+{
+	uint64_t id, x;
+
+	r.type = (trace_event) *p++;
+	if (!varint(id) || !varint(r.delay_us))
+		return false;
+	r.id = id;
+
+	switch (r.type)
+	{
+		case trace_event::open:
+			if (end - p < 4)
+				return false;
+			memcpy(&r.addr, p, 4);
+			p += 4;
+			if (!varint(x))
+				return false;
+			r.port = x;
+			return true;
+		case trace_event::connect:
+		case trace_event::eof:
+			if (!varint(x))
+				return false;
+			r.err = x;
+			return true;
+		case trace_event::data:
+			if (!varint(x) || (uint64_t) (end - p) < x)
+				return false;
+			r.data = string_view((const char*) p, x);
+			p += x;
+			return true;
+		case trace_event::close:
+			return true;
+	}
+
+	return false;
+}
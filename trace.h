@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <stdio.h>
+
+/* Per-connection event traces, to replay a scan without the network. A trace
+ * is "CONNTRC1" followed by records: a type byte, then the connection's id and
+ * the microseconds since the previous record as varints, then the payload. */
+enum class trace_event : uint8_t
+{
+	open = 1,	/* address (4 bytes, network order), port */
+	connect,	/* error, 0 if connected */
+	data,		/* length, bytes: one read() */
+	eof,		/* error, 0 if the other side closed */
+	close,		/* we hung up */
+};
+
+class trace_writer
+{
+public:
+	~trace_writer();
+
+	bool open(const std::string& filename);
+	bool close();
+
+	/* Returns the new connection's id */
+	uint32_t opened(uint32_t addr, int port);
+
+	void connected(uint32_t id, int err);
+	void data(uint32_t id, const void* buf, size_t n);
+	void eof(uint32_t id, int err);
+	void closed(uint32_t id);
+
+private:
+	void header(trace_event type, uint32_t id);
+	void varint(uint64_t x);
+	void flush();
+
+	FILE* f = nullptr;
+	std::string buf;
+	std::chrono::steady_clock::time_point last;
+	uint32_t next_id = 0;
+};
+
+struct trace_record
+{
+	trace_event type;
+	uint32_t id;
+	uint64_t delay_us;
+
+	uint32_t addr;
+	int port;
+	int err;
+	std::string_view data;
+};
+
+/* Maps the whole trace; data in the records points into the mapping */
+class trace_reader
+{
+public:
+	~trace_reader();
+
+	bool open(const std::string& filename);
+
+	bool next(trace_record& r);
+	void rewind() { p = start; }
+
+	/* Whether next() stopped short of the end */
+	bool truncated() { return p != end; }
+
+private:
+	bool parse(trace_record& r);
+	bool varint(uint64_t& x);
+
+	const unsigned char* map = nullptr;
+	size_t size = 0;
+	const unsigned char* start = nullptr;
+	const unsigned char* p = nullptr;
+	const unsigned char* end = nullptr;
+};
+
+#endif /* TRACE_H */